@@ -0,0 +1,136 @@
+// Copyright (c) Mathieu Malaterre
+// SPDX-License-Identifier: BSD-3-Clause
+#include "allocator.h"
+
+#include <cstdlib> // for posix_memalign, free
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+#ifdef HAVE_MMAP
+#include <sys/mman.h> // for madvise
+#endif
+
+namespace jlst {
+namespace {
+const size_t pooled_size = 1 << 20;
+// size and alignment of a transparent huge page on x86-64 and arm64
+const size_t huge_page_size = 2 << 20;
+const size_t max_cached_blocks = 8;
+// total size of the cached blocks, a few large images at most
+const size_t max_cached_bytes = size_t{512} << 20;
+
+struct pool_state
+{
+    std::mutex mutex;
+    // cached blocks by size, and the size of the blocks in use:
+    std::multimap<size_t, void*> cached;
+    size_t cached_bytes{};
+    std::unordered_map<void*, size_t> in_use;
+};
+
+pool_state& get_state()
+{
+    // never destroyed, buffers may be freed during static destruction:
+    static pool_state* state = new pool_state;
+    return *state;
+}
+
+void* system_allocate(size_t size)
+{
+#ifdef HAVE_MMAP
+    void* p = nullptr;
+    if (posix_memalign(&p, huge_page_size, size) != 0)
+        throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+    // only a hint, the kernel may not support it:
+    madvise(p, size, MADV_HUGEPAGE);
+#endif
+    return p;
+#else
+    return ::operator new(size);
+#endif
+}
+
+void system_free(void* p) noexcept
+{
+#ifdef HAVE_MMAP
+    std::free(p);
+#else
+    ::operator delete(p);
+#endif
+}
+} // namespace
+
+void* block_pool::allocate(size_t size)
+{
+    if (size < pooled_size)
+        return ::operator new(size);
+    const size_t rounded = (size + huge_page_size - 1) / huge_page_size * huge_page_size;
+    auto& state = get_state();
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        // a cached block at most 25% larger than needed:
+        auto it = state.cached.lower_bound(rounded);
+        if (it != state.cached.end() && it->first <= rounded + rounded / 4)
+        {
+            void* p = it->second;
+            state.in_use.emplace(p, it->first);
+            state.cached_bytes -= it->first;
+            state.cached.erase(it);
+            return p;
+        }
+    }
+    void* p = system_allocate(rounded);
+    try
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.in_use.emplace(p, rounded);
+    }
+    catch (...)
+    {
+        system_free(p);
+        throw;
+    }
+    return p;
+}
+
+void block_pool::deallocate(void* p, size_t size) noexcept
+{
+    if (!p)
+        return;
+    if (size < pooled_size)
+    {
+        ::operator delete(p);
+        return;
+    }
+    auto& state = get_state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    auto it = state.in_use.find(p);
+    const size_t block_size = it->second;
+    state.in_use.erase(it);
+    try
+    {
+        if (state.cached.size() < max_cached_blocks && state.cached_bytes + block_size <= max_cached_bytes)
+        {
+            state.cached.emplace(block_size, p);
+            state.cached_bytes += block_size;
+            return;
+        }
+    }
+    catch (...)
+    {
+    }
+    system_free(p);
+}
+
+void block_pool::release() noexcept
+{
+    auto& state = get_state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    for (auto& block : state.cached)
+        system_free(block.second);
+    state.cached.clear();
+    state.cached_bytes = 0;
+}
+} // namespace jlst
@@ -0,0 +1,81 @@
+// Copyright (c) Mathieu Malaterre
+// SPDX-License-Identifier: BSD-3-Clause
+#pragma once
+
+#include <cstddef> // for size_t
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace jlst {
+/**
+ * Process-wide pool of large blocks (1 MiB and up): freed blocks are kept and
+ * handed out again for requests of about the same size, so that the images of
+ * a batch run recycle the same memory instead of faulting in fresh pages.
+ * At most 8 blocks and 512 MiB are cached, until `release()`. Large blocks
+ * are 2 MiB aligned and advised for transparent huge pages where supported.
+ * Smaller requests go to operator new. Thread safe.
+ */
+struct block_pool final
+{
+    static void* allocate(size_t size);
+    static void deallocate(void* p, size_t size) noexcept;
+    // frees the cached blocks, eg. once a batch is done
+    static void release() noexcept;
+};
+
+/**
+ * Allocator backed by block_pool whose `construct()` default-initializes, so
+ * that `resize()` does not zero-fill bytes about to be overwritten by a
+ * decoder or a read. Use an explicit value (`resize(n, 0)`) when zeros are
+ * needed.
+ */
+template<typename T>
+class default_init_allocator
+{
+public:
+    typedef T value_type;
+
+    default_init_allocator() noexcept = default;
+    template<typename U>
+    default_init_allocator(const default_init_allocator<U>&) noexcept
+    {
+    }
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(block_pool::allocate(n * sizeof(T)));
+    }
+    void deallocate(T* p, size_t n) noexcept
+    {
+        block_pool::deallocate(p, n * sizeof(T));
+    }
+
+    template<typename U>
+    void construct(U* p) noexcept(std::is_nothrow_default_constructible<U>::value)
+    {
+        ::new (static_cast<void*>(p)) U;
+    }
+    template<typename U, typename... Args>
+    void construct(U* p, Args&&... args) noexcept(std::is_nothrow_constructible<U, Args...>::value)
+    {
+        ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+    }
+};
+
+template<typename T, typename U>
+bool operator==(const default_init_allocator<T>&, const default_init_allocator<U>&) noexcept
+{
+    return true;
+}
+template<typename T, typename U>
+bool operator!=(const default_init_allocator<T>&, const default_init_allocator<U>&) noexcept
+{
+    return false;
+}
+
+// pixel data and codestream buffers
+typedef std::vector<uint8_t, default_init_allocator<uint8_t>> byte_buffer;
+} // namespace jlst
@@ -1,22 +1,27 @@
 // Copyright (c) Mathieu Malaterre
 // SPDX-License-Identifier: BSD-3-Clause
+#include "allocator.h"           // for block_pool
 #include "cjpls_options.h"       // for cjpls_options
 #include "factory.h"             // for factory
 #include "format.h"              // for format
 #include "image.h"               // for image, image_info
+#include "parallel.h"            // for parallel
+#include "search.h"              // for search
+#include "source.h"              // for source
+#include "stats.h"               // for stats
 #include <charls/public_types.h> // for frame_info
 #include <cstdlib>               // for EXIT_FAILURE, EXIT_SUCCESS
 #include <iostream>              // for operator<<, endl, basic_ostream, cerr
 #include <memory>                // for unique_ptr
+#include <mutex>                 // for mutex, lock_guard
+#include <sstream>               // for ostringstream
 #include <stdexcept>             // for invalid_argument
+#include <utility>               // for move
 #include <vector>                // for vector
-namespace jlst {
-class source;
-}
 
-static std::unique_ptr<jlst::format> get_format(const jlst::cjpls_options& options, jlst::source& source)
+static std::unique_ptr<jlst::format> get_format(std::string const& type, jlst::source& source)
 {
-    jlst::format* ptr = jlst::factory::instance().get_format_from_type(options.get_type());
+    jlst::format* ptr = jlst::factory::instance().get_format_from_type(type);
     if (!ptr)
         ptr = jlst::factory::instance().detect_format(source);
     if (ptr)
@@ -24,10 +29,11 @@ static std::unique_ptr<jlst::format> get_format(const jlst::cjpls_options& optio
     throw std::invalid_argument("no format");
 }
 
-static jlst::image combine_images(std::vector<jlst::image> const& images)
+// the images are moved from, not copied
+static jlst::image combine_images(std::vector<jlst::image>& images)
 {
     if (images.size() == 1)
-        return images[0];
+        return std::move(images[0]);
     else if (images.size() == 3)
     {
         jlst::image ret;
@@ -42,21 +48,92 @@ static jlst::image combine_images(std::vector<jlst::image> const& images)
     throw std::invalid_argument("combine_images");
 }
 
+// striped container when more than one stripe is requested
+static const char* output_type(jlst::cjpls_options const& options)
+{
+    return options.get_jls_options().stripes > 1 ? "jlss" : "jls";
+}
+
+// option values indexed by enum value
+static const char* const interleave_modes[] = {"none", "line", "sample"};
+static const char* const color_transformations[] = {"none", "hp1", "hp2", "hp3"};
+
+// output options, with the coding mode and preset coding parameters found by trial encoding when requested
+static jlst::jls_options get_jls_options(jlst::cjpls_options const& options, jlst::image const& image,
+                                         std::string const& filename)
+{
+    jlst::jls_options jo = options.get_jls_options();
+    if (options.auto_mode)
+    {
+        jo = jlst::search::coding_mode(image, jo, options.sample_rows, jo.jobs);
+        std::ostringstream os;
+        os << (filename.empty() ? "-" : filename) << ": interleave_mode "
+           << interleave_modes[static_cast<int>(jo.interleave_mode)] << ", color_transformation "
+           << color_transformations[static_cast<int>(jo.color_transformation)] << '\n';
+        std::cerr << os.str();
+    }
+    if (options.optimize_pcp)
+        jo.preset_coding_parameters = jlst::search::preset_coding_parameters(image, jo, options.sample_rows, jo.jobs);
+    return jo;
+}
+
 static void encode(jlst::cjpls_options& options)
 {
     auto& sources = options.get_sources();
     std::vector<jlst::image> images;
     for (auto& source : sources)
     {
-        auto format = get_format(options, source);
-        auto input_image{format->load(source, options.get_image_info())};
-        images.push_back(input_image);
+        auto format = get_format(options.get_type(), source);
+        images.push_back(format->load(source, options.get_image_info()));
     }
 
     auto image{combine_images(images)};
 
-    std::unique_ptr<jlst::format> jls_format(jlst::factory::instance().get_format_from_type("jls"));
-    jls_format->save(options.get_dest(0), image, options.get_jls_options());
+    const jlst::jls_options jo = get_jls_options(options, image, sources[0].get_filename());
+    if (!options.save_pcp.empty())
+    {
+        jlst::dest profile(options.save_pcp);
+        jlst::search::save_preset_coding_parameters(profile, jo.preset_coding_parameters);
+    }
+
+    std::unique_ptr<jlst::format> jls_format(jlst::factory::instance().get_format_from_type(output_type(options)));
+    jls_format->save(options.get_dest(0), image, jo);
+}
+
+// each worker creates its jls format once and reuses it across jobs; the charls
+// encoder itself is created for every image:
+static bool encode_batch(jlst::cjpls_options& options)
+{
+    auto& batch = options.get_batch();
+    const unsigned int nworkers = jlst::parallel::concurrency(options.jobs);
+    std::vector<std::unique_ptr<jlst::format>> jls_formats(nworkers);
+    std::mutex cerr_mutex;
+    bool success = true;
+    jlst::parallel::for_each(batch.size(), options.jobs, [&](size_t index, unsigned int worker) {
+        auto& filenames = batch[index];
+        try
+        {
+            auto& jls_format = jls_formats[worker];
+            if (!jls_format)
+                jls_format.reset(jlst::factory::instance().get_format_from_type(output_type(options)));
+            jlst::source source(filenames.first);
+            auto type = options.get_type().empty() ? jlst::cjpls_options::compute_type_from_filename(filenames.first)
+                                                    : options.get_type();
+            auto format = get_format(type, source);
+            auto image{format->load(source, options.get_image_info())};
+            jlst::dest dest(filenames.second);
+            jls_format->save(dest, image, get_jls_options(options, image, filenames.first));
+        }
+        catch (std::exception& e)
+        {
+            std::lock_guard<std::mutex> lock(cerr_mutex);
+            std::cerr << "Error during encoding " << filenames.first << ": " << e.what() << std::endl;
+            success = false;
+        }
+    });
+    // the cached image buffers are of no use anymore:
+    jlst::block_pool::release();
+    return success;
 }
 
 int main(int argc, char* argv[])
@@ -81,20 +158,25 @@ int main(int argc, char* argv[])
         return EXIT_FAILURE;
     }
 
+    bool success = true;
     try
     {
-        encode(options);
+        if (options.is_batch())
+            success = encode_batch(options);
+        else
+            encode(options);
     }
     catch (std::exception& e)
     {
         std::cerr << "Error during encoding: " << e.what() << std::endl;
-        return EXIT_FAILURE;
+        success = false;
     }
     catch (...)
     {
         std::cerr << "unknown exception during encoding" << std::endl;
-        return EXIT_FAILURE;
+        success = false;
     }
+    jlst::stats::report();
 
-    return EXIT_SUCCESS;
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -2,6 +2,9 @@
 // SPDX-License-Identifier: BSD-3-Clause
 #include "cjpls_options.h"
 
+#include "search.h"
+#include "source.h"
+#include "stats.h"
 #include "tuple.h"
 #include "version.h"
 #include <boost/program_options.hpp>
@@ -60,6 +63,8 @@ bool cjpls_options::process(int argc, char* argv[])
     std::string interleave_mode_str{};
     std::string color_transformation_str{};
     std::string planar_configuration_str{};
+    std::string load_pcp{};
+    std::string stats_file{};
     pcp_type pcp{};
     size_type size{};
     auto& frame_info = image_info_.frame_info();
@@ -73,6 +78,15 @@ bool cjpls_options::process(int argc, char* argv[])
             ("type", po::value(&type_), "Input type (pgm, raw...).")               // input type
             ;
 
+        po::options_description batch("Batch options");
+        batch.add_options() //
+            ("batch", "Process each input/output pair as an independent job. "
+                      "Pairs are read as a NUL separated list from stdin when no input is given.") // batch
+            ("jobs,j", po::value(&jobs), "Number of worker threads, 0 for one per core (default 1).") // jobs
+            ("stats", "Print per-phase timing statistics to stderr.")                                 // stats
+            ("stats-file", po::value(&stats_file), "Write per-phase timing statistics as JSON to a file.") // stats
+            ;
+
         po::options_description jpegls("JPEG-LS output options");
         jpegls.add_options() //
             ("interleave_mode,m", po::value(&interleave_mode_str),
@@ -86,6 +100,19 @@ bool cjpls_options::process(int argc, char* argv[])
              "Write a standard spiff header: 'yes'/'no'.") // spiff header
             ("color_transformation,t", po::value(&color_transformation_str),
              "Color transformation: `none|hp1|hp2|hp3` (HP extension).") // color transformation
+            ("stripes", po::value(&jls_options_.stripes),
+             "Split into N horizontal stripes encoded concurrently (striped JPEG-LS container).") // stripes
+            ;
+
+        po::options_description search("Trial encoding options");
+        search.add_options() //
+            ("auto", "Trial encode every legal interleave mode and color transformation, keep the smallest.") // auto
+            ("optimize-pcp", "Trial encode with candidate thresholds and reset value, keep the smallest.") // optimize
+            ("sample-rows", po::value(&sample_rows),
+             "Number of rows trial encoded, taken from evenly spaced bands, 0 for the whole image (default 256).") //
+            ("save-pcp", po::value(&save_pcp), "Save the preset coding parameters found to a profile file.") // save
+            ("load-pcp", po::value(&load_pcp),
+             "Read the preset coding parameters from a profile file (see --save-pcp).") // load
             ;
 
         po::options_description image("Image input options");
@@ -115,7 +142,9 @@ bool cjpls_options::process(int argc, char* argv[])
             ;
 
         desc.add(generic);
+        desc.add(batch);
         desc.add(jpegls);
+        desc.add(search);
 #if CHARLS_VERSION_MAJOR > 2 || (CHARLS_VERSION_MAJOR == 2 && CHARLS_VERSION_MINOR > 2)
         desc.add(encoding);
 #endif
@@ -146,28 +175,41 @@ bool cjpls_options::process(int argc, char* argv[])
         try
         {
             po::notify(vm);
+            if (vm.count("stats") || vm.count("stats-file"))
+                stats::enable(stats_file);
 
-            // let's pretend that input/output are actually required:
-            if (vm.count("input"))
+            if (vm.count("batch"))
             {
-                add_inputs(inputs);
-                if (!vm.count("type"))
-                {
-                    type_ = compute_type_from_filenames(inputs);
-                }
+                // input type is computed for each job, unless specified:
+                if (vm.count("input"))
+                    add_batch(inputs, outputs);
+                else
+                    add_stdin_batch();
             }
             else
             {
-                add_stdin_input();
-            }
+                // let's pretend that input/output are actually required:
+                if (vm.count("input"))
+                {
+                    add_inputs(inputs);
+                    if (!vm.count("type"))
+                    {
+                        type_ = compute_type_from_filenames(inputs);
+                    }
+                }
+                else
+                {
+                    add_stdin_input();
+                }
 
-            if (vm.count("output"))
-            {
-                add_outputs(outputs);
-            }
-            else
-            {
-                add_stdout_output();
+                if (vm.count("output"))
+                {
+                    add_outputs(outputs);
+                }
+                else
+                {
+                    add_stdout_output();
+                }
             }
         }
         catch (std::exception&)
@@ -180,6 +222,8 @@ bool cjpls_options::process(int argc, char* argv[])
 
         jls_options_.interleave_mode = charls::interleave_mode::none;
         jls_options_.color_transformation = charls::color_transformation::none;
+        // stripes of a single image use the worker threads, batch jobs are already concurrent:
+        jls_options_.jobs = vm.count("batch") ? 1 : jobs;
         planar_configuration = charls::interleave_mode::sample;
 
         if (vm.count("color_transformation"))
@@ -201,6 +245,17 @@ bool cjpls_options::process(int argc, char* argv[])
             jls_options_.preset_coding_parameters.threshold3 = val[3];
             jls_options_.preset_coding_parameters.reset_value = val[4];
         }
+        auto_mode = vm.count("auto") != 0;
+        optimize_pcp = vm.count("optimize-pcp") != 0;
+        if (vm.count("load-pcp"))
+        {
+            if (vm.count("preset_coding_parameters") || optimize_pcp)
+                throw std::invalid_argument("load-pcp excludes preset_coding_parameters and optimize-pcp");
+            source profile(load_pcp);
+            jls_options_.preset_coding_parameters = search::load_preset_coding_parameters(profile);
+        }
+        if (vm.count("save-pcp") && (!optimize_pcp || vm.count("batch")))
+            throw std::invalid_argument("save-pcp requires optimize-pcp on a single image");
         if (vm.count("size"))
         {
             const int* val = size.values;
@@ -17,6 +17,10 @@ struct jls_options final
     bool has_color_transformation{};
     charls::color_transformation color_transformation{};
     bool standard_spiff_header{true};
+    // more than one: striped container of independent stripes (see jlss.h)
+    uint32_t stripes{};
+    // threads encoding the stripes, 0 for one per core
+    int jobs{1};
 #if CHARLS_VERSION_MAJOR > 2 || (CHARLS_VERSION_MAJOR == 2 && CHARLS_VERSION_MINOR > 2)
     charls::encoding_options encoding_options{};
 #endif
@@ -41,6 +45,14 @@ struct cjpls_options final : options
     {
         return jls_options_;
     }
+
+    // trial encoding of `sample_rows` rows (0: whole image) to pick the interleave mode and color
+    // transformation (--auto), and the preset coding parameters (--optimize-pcp)
+    bool auto_mode{};
+    bool optimize_pcp{};
+    uint32_t sample_rows{256};
+    // profile file receiving the parameters found, empty when not requested
+    std::string save_pcp{};
     /**
      * Returns false when the process should stop, ie `help` or `version` was passed.
      * Returns true when the next step encode/decode should continue.
@@ -0,0 +1,45 @@
+// Copyright (c) Mathieu Malaterre
+// SPDX-License-Identifier: BSD-3-Clause
+#include "cpu.h"
+
+namespace jlst {
+#ifdef JLST_X86_DISPATCH
+bool cpu::has_ssse3()
+{
+    static const bool b = __builtin_cpu_supports("ssse3");
+    return b;
+}
+bool cpu::has_sse41()
+{
+    static const bool b = __builtin_cpu_supports("sse4.1");
+    return b;
+}
+bool cpu::has_pclmul()
+{
+    static const bool b = __builtin_cpu_supports("pclmul");
+    return b;
+}
+bool cpu::has_avx2()
+{
+    static const bool b = __builtin_cpu_supports("avx2");
+    return b;
+}
+#else
+bool cpu::has_ssse3()
+{
+    return false;
+}
+bool cpu::has_sse41()
+{
+    return false;
+}
+bool cpu::has_pclmul()
+{
+    return false;
+}
+bool cpu::has_avx2()
+{
+    return false;
+}
+#endif
+} // namespace jlst
@@ -0,0 +1,20 @@
+// Copyright (c) Mathieu Malaterre
+// SPDX-License-Identifier: BSD-3-Clause
+#pragma once
+
+// Runtime CPU feature detection. Kernels using instruction set extensions are
+// compiled with a per-function target attribute and selected at runtime, so
+// that the tools still run on any x86 baseline.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define JLST_X86_DISPATCH 1
+#endif
+
+namespace jlst {
+struct cpu final
+{
+    static bool has_ssse3();
+    static bool has_sse41();
+    static bool has_pclmul();
+    static bool has_avx2();
+};
+} // namespace jlst
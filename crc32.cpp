@@ -2,17 +2,264 @@
 // SPDX-License-Identifier: BSD-3-Clause
 #include "crc32.h"
 
-#include <boost/crc.hpp>
-#include <cstdio> // std::sprintf
+#include "cpu.h"
+#include "parallel.h"
+
+#include <cstdio>  // std::sprintf
+
+#ifdef JLST_X86_DISPATCH
+#include <immintrin.h>
+#endif
 
 namespace jlst {
-std::string crc32::compute(std::vector<uint8_t> const& buffer)
+namespace {
+constexpr uint32_t polynomial = 0xedb88320; // reflected 0x04c11db7
+
+// slicing-by-8 lookup tables:
+struct crc32_tables
+{
+    uint32_t t[8][256];
+    crc32_tables()
+    {
+        for (uint32_t n = 0; n < 256; ++n)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k)
+                c = c & 1 ? polynomial ^ (c >> 1) : c >> 1;
+            t[0][n] = c;
+        }
+        for (uint32_t n = 0; n < 256; ++n)
+        {
+            for (int k = 1; k < 8; ++k)
+                t[k][n] = t[0][t[k - 1][n] & 0xff] ^ (t[k - 1][n] >> 8);
+        }
+    }
+};
+
+const crc32_tables& tables()
+{
+    static const crc32_tables tables_;
+    return tables_;
+}
+
+// `crc` is the internal (non inverted) register
+uint32_t crc32_slice8(uint32_t crc, const uint8_t* p, size_t len)
+{
+    const auto& t = tables().t;
+    while (len >= 8)
+    {
+        // little endian load, the byte order of the table lookups below:
+        const uint32_t lo = crc ^ (static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 |
+                                   static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24);
+        const uint32_t hi = static_cast<uint32_t>(p[4]) | static_cast<uint32_t>(p[5]) << 8 |
+                            static_cast<uint32_t>(p[6]) << 16 | static_cast<uint32_t>(p[7]) << 24;
+        crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len--)
+        crc = t[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+#ifdef JLST_X86_DISPATCH
+// Carry-less multiplication folding, see "Fast CRC Computation for Generic
+// Polynomials Using PCLMULQDQ Instruction" (Intel, 2009). Constants are for
+// the bit-reflected domain. Requires len >= 64 and a multiple of 16.
+__attribute__((target("pclmul,sse4.1"))) uint32_t crc32_pclmul(uint32_t crc, const uint8_t* buf, size_t len)
+{
+    alignas(16) static const uint64_t k1k2[] = {0x0154442bd4, 0x01c6e41596};
+    alignas(16) static const uint64_t k3k4[] = {0x01751997d0, 0x00ccaa009e};
+    alignas(16) static const uint64_t k5k0[] = {0x0163cd6124, 0x0000000000};
+    alignas(16) static const uint64_t poly[] = {0x01db710641, 0x01f7011641};
+
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+    x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x00));
+    x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x10));
+    x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x20));
+    x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(crc)));
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k1k2));
+    buf += 64;
+    len -= 64;
+
+    // fold 4 x 128 bits in parallel:
+    while (len >= 64)
+    {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        y5 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x00));
+        y6 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x10));
+        y7 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x20));
+        y8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x30));
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+        buf += 64;
+        len -= 64;
+    }
+
+    // fold into 128 bits:
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k3k4));
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // remaining 128 bits blocks:
+    while (len >= 16)
+    {
+        x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf));
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+        buf += 16;
+        len -= 16;
+    }
+
+    // fold 128 bits to 64 bits:
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+    x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(k5k0));
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction to 32 bits:
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(poly));
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+}
+#endif
+
+// zlib crc32_combine, operators on GF(2) 32x32 matrices:
+uint32_t gf2_matrix_times(const uint32_t* mat, uint32_t vec)
+{
+    uint32_t sum = 0;
+    while (vec)
+    {
+        if (vec & 1)
+            sum ^= *mat;
+        vec >>= 1;
+        mat++;
+    }
+    return sum;
+}
+
+void gf2_matrix_square(uint32_t* square, const uint32_t* mat)
+{
+    for (int n = 0; n < 32; n++)
+        square[n] = gf2_matrix_times(mat, mat[n]);
+}
+} // namespace
+
+uint32_t crc32::update(uint32_t crc, const void* data, size_t size)
+{
+    auto p = static_cast<const uint8_t*>(data);
+    crc = ~crc;
+#ifdef JLST_X86_DISPATCH
+    if (size >= 64 && cpu::has_pclmul() && cpu::has_sse41())
+    {
+        const size_t len = size & ~static_cast<size_t>(15);
+        crc = crc32_pclmul(crc, p, len);
+        p += len;
+        size -= len;
+    }
+#endif
+    crc = crc32_slice8(crc, p, size);
+    return ~crc;
+}
+
+uint32_t crc32::combine(uint32_t crc1, uint32_t crc2, size_t size2)
+{
+    if (size2 == 0)
+        return crc1;
+
+    uint32_t even[32]; // even-power-of-two zeros operator
+    uint32_t odd[32];  // odd-power-of-two zeros operator
+
+    // operator for one zero bit in odd:
+    odd[0] = polynomial;
+    uint32_t row = 1;
+    for (int n = 1; n < 32; n++)
+    {
+        odd[n] = row;
+        row <<= 1;
+    }
+    gf2_matrix_square(even, odd); // two zero bits
+    gf2_matrix_square(odd, even); // four zero bits
+
+    // apply size2 zeros to crc1 (first square will put the operator for one
+    // zero byte, eight zero bits, in even):
+    do
+    {
+        gf2_matrix_square(even, odd);
+        if (size2 & 1)
+            crc1 = gf2_matrix_times(even, crc1);
+        size2 >>= 1;
+        if (size2 == 0)
+            break;
+        gf2_matrix_square(odd, even);
+        if (size2 & 1)
+            crc1 = gf2_matrix_times(odd, crc1);
+        size2 >>= 1;
+    } while (size2 != 0);
+
+    return crc1 ^ crc2;
+}
+
+uint32_t crc32::checksum(const void* data, size_t size, int jobs)
+{
+    // below this size, thread startup costs more than it saves:
+    const size_t min_chunk_size = 4 << 20;
+    size_t nchunks = parallel::concurrency(jobs);
+    if (size / min_chunk_size < nchunks)
+        nchunks = size / min_chunk_size;
+    if (nchunks <= 1)
+        return update(0, data, size);
+
+    auto p = static_cast<const uint8_t*>(data);
+    const size_t chunk_size = size / nchunks;
+    std::vector<uint32_t> crcs(nchunks);
+    parallel::for_each(nchunks, jobs, [&](size_t index, unsigned int) {
+        const size_t len = index + 1 == nchunks ? size - index * chunk_size : chunk_size;
+        crcs[index] = update(0, p + index * chunk_size, len);
+    });
+    uint32_t crc = crcs[0];
+    for (size_t index = 1; index < nchunks; ++index)
+    {
+        const size_t len = index + 1 == nchunks ? size - index * chunk_size : chunk_size;
+        crc = combine(crc, crcs[index], len);
+    }
+    return crc;
+}
+
+std::string crc32::compute(byte_buffer const& buffer, int jobs)
 {
-    boost::crc_32_type result;
-    result.process_bytes(buffer.data(), buffer.size());
-    uint32_t checksum = result.checksum();
+    const uint32_t value = checksum(buffer.data(), buffer.size(), jobs);
     char crc32[16];
-    std::sprintf(crc32, "%8x", checksum);
+    std::sprintf(crc32, "%8x", value);
     return crc32;
 }
 } // namespace jlst
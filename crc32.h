@@ -2,14 +2,27 @@
 // SPDX-License-Identifier: BSD-3-Clause
 #pragma once
 
+#include "allocator.h"
+
+#include <cstddef>
 #include <cstdint>
 #include <string>
-#include <vector>
 
 namespace jlst {
+// CRC-32 (ISO-HDLC, same as boost::crc_32_type / zlib)
 class crc32
 {
 public:
-    static std::string compute(std::vector<uint8_t> const& buffer);
+    /**
+     * Returns the checksum formatted as `%8x`. Large buffers are split across
+     * `jobs` threads (0 for one per core) and the partial checksums combined.
+     */
+    static std::string compute(byte_buffer const& buffer, int jobs = 1);
+
+    // continue checksum `crc` (0 for an empty prefix) with `size` more bytes
+    static uint32_t update(uint32_t crc, const void* data, size_t size);
+    // checksum of the concatenation A|B, from crc(A), crc(B) and size of B
+    static uint32_t combine(uint32_t crc1, uint32_t crc2, size_t size2);
+    static uint32_t checksum(const void* data, size_t size, int jobs = 1);
 };
 } // end namespace jlst
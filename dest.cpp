@@ -3,8 +3,17 @@
 
 #include "dest.h"
 
+#include "stats.h"
+
 #include <stdexcept>
 
+#ifdef HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace jlst {
 
 dest::dest() : stream_(stdout)
@@ -13,7 +22,8 @@ dest::dest() : stream_(stdout)
 
 dest::dest(std::string const& filename)
 {
-    stream_ = std::fopen(filename.c_str(), "wb");
+    // open for update so that the file can be memory-mapped (see reserve)
+    stream_ = std::fopen(filename.c_str(), "w+b");
     if (!stream_)
         throw std::invalid_argument("bogus filename");
     filename_ = filename;
@@ -21,13 +31,94 @@ dest::dest(std::string const& filename)
 
 dest::~dest()
 {
+#ifdef HAVE_MMAP
+    if (mapping_)
+    {
+        // reserve without commit (eg. the encoder threw): drop the preallocated bytes
+        munmap(mapping_, mapping_size_);
+        if (ftruncate(fileno(stream_), static_cast<off_t>(offset_)) != 0)
+        {
+            // nothing sensible to do in a destructor
+        }
+    }
+#endif
     if (!filename_.empty())
         std::fclose(stream_);
 }
 
 size_t dest::write(const void* ptr, size_t n)
 {
+    stats::scope scope(stats::write, 0, n);
     return std::fwrite(ptr, 1, n, stream_);
 }
 
+uint8_t* dest::reserve(size_t n)
+{
+    if (mapping_ || !buffer_.empty())
+        throw std::logic_error("reserve already in progress");
+#ifdef HAVE_MMAP
+    struct stat st;
+    const int fd = fileno(stream_);
+    if (n > 0 && std::fflush(stream_) == 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+    {
+        const off_t pos = lseek(fd, 0, SEEK_CUR);
+        // mmap offset must be page aligned:
+        const off_t page_size = sysconf(_SC_PAGESIZE);
+        const off_t map_offset = pos - pos % page_size;
+        const size_t len = static_cast<size_t>(pos - map_offset) + n;
+        // make sure blocks are actually allocated on disk, so that we get an
+        // error now rather than a SIGBUS later (eg. disk full):
+        if (pos >= 0 && posix_fallocate(fd, pos, static_cast<off_t>(n)) == 0)
+        {
+            void* addr = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, map_offset);
+            if (addr != MAP_FAILED)
+            {
+                mapping_ = addr;
+                mapping_size_ = len;
+                offset_ = static_cast<size_t>(pos);
+                return static_cast<uint8_t*>(addr) + (pos - map_offset);
+            }
+            // restore previous size:
+            if (ftruncate(fd, pos) != 0)
+                throw std::runtime_error("ftruncate");
+        }
+    }
+#endif
+    // fallback: stream is not a regular file (stdout, pipes):
+    buffer_.resize(n);
+    return buffer_.data();
+}
+
+void dest::commit(size_t n)
+{
+#ifdef HAVE_MMAP
+    if (mapping_)
+    {
+        // the mapping starts at the page holding offset_:
+        const size_t reserved = mapping_size_ - offset_ % static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        if (n > reserved)
+            throw std::invalid_argument("commit larger than reserve");
+        // the bytes were written in place, only the mapping and the file size are updated:
+        stats::scope scope(stats::write, 0, n);
+        const size_t end = offset_ + n;
+        munmap(mapping_, mapping_size_);
+        mapping_ = nullptr;
+        mapping_size_ = 0;
+        // discard unused preallocated bytes:
+        if (ftruncate(fileno(stream_), static_cast<off_t>(end)) != 0)
+            throw std::runtime_error("ftruncate");
+        if (fseeko(stream_, static_cast<off_t>(end), SEEK_SET) != 0)
+            throw std::runtime_error("fseeko");
+        return;
+    }
+#endif
+    if (n > buffer_.size())
+        throw std::invalid_argument("commit larger than reserve");
+    const size_t nw = write(buffer_.data(), n);
+    buffer_.clear();
+    buffer_.shrink_to_fit();
+    if (nw != n)
+        throw std::runtime_error("write failure");
+}
+
 } // end namespace jlst
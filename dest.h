@@ -2,6 +2,9 @@
 // SPDX-License-Identifier: BSD-3-Clause
 #pragma once
 
+#include "allocator.h"
+
+#include <cstdint>
 #include <cstdio>
 #include <string>
 
@@ -15,12 +18,31 @@ public:
 
     size_t write(const void* ptr, size_t n);
 
+    /**
+     * Reserves `n` bytes at the current position and returns a writable
+     * pointer to them. Regular files are preallocated on disk and
+     * memory-mapped, other streams (stdout, pipes) use an internal buffer.
+     * The pointer is valid until `commit` is called.
+     */
+    uint8_t* reserve(size_t n);
+    /**
+     * Completes a `reserve` call: only the first `n` bytes are kept, the
+     * file is truncated to its actual size.
+     */
+    void commit(size_t n);
+
     dest(dest&& s)
     {
         stream_ = s.stream_;
         filename_ = s.filename_;
+        mapping_ = s.mapping_;
+        mapping_size_ = s.mapping_size_;
+        offset_ = s.offset_;
+        buffer_.swap(s.buffer_);
         s.stream_ = nullptr;
         s.filename_ = "";
+        s.mapping_ = nullptr;
+        s.mapping_size_ = 0;
     }
 
 private:
@@ -30,6 +52,10 @@ private:
 
     FILE* stream_;
     std::string filename_;
+    void* mapping_{};
+    size_t mapping_size_{};
+    size_t offset_{};
+    byte_buffer buffer_{};
 };
 
 } // namespace jlst
@@ -1,37 +1,102 @@
 // Copyright (c) Mathieu Malaterre
 // SPDX-License-Identifier: BSD-3-Clause
+#include "allocator.h"
 #include "cjpls_options.h"
 #include "djpls_options.h"
 #include "factory.h"
 #include "image.h"
 #include "jls.h"
+#include "jlss.h"
+#include "parallel.h"
 #include "pnm.h"
 #include "raw.h"
+#include "stats.h"
 
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 // compute output format (do not inspect source)
-static std::unique_ptr<jlst::format> get_format(jlst::djpls_options& options)
+static std::unique_ptr<jlst::format> get_format(std::string const& type)
 {
-    jlst::format* ptr = jlst::factory::instance().get_format_from_type(options.get_type());
+    jlst::format* ptr = jlst::factory::instance().get_format_from_type(type);
     if (ptr)
         return std::unique_ptr<jlst::format>(ptr);
 
     throw std::invalid_argument("no format");
 }
 
+// striped JPEG-LS inputs are detected by signature, stripes are decoded using `jobs` threads
+static bool is_striped(jlst::source& source)
+{
+    std::unique_ptr<jlst::format> detected(jlst::factory::instance().detect_format(source));
+    return detected && detected->handle_type("jlss");
+}
+
 static void decode(jlst::djpls_options& options)
 {
     jlst::image input_image;
-    std::unique_ptr<jlst::format> jls_format(jlst::factory::instance().get_format_from_type("jls"));
-    input_image = jls_format->load(options.get_source(0), input_image.get_image_info());
+    auto& source = options.get_source(0);
+    std::unique_ptr<jlst::format> jls_format(
+        is_striped(source) ? new jlst::jlss(options.jobs) : jlst::factory::instance().get_format_from_type("jls"));
+    input_image = jls_format->load(source, input_image.get_image_info());
 
-    auto format = get_format(options);
+    auto format = get_format(options.get_type());
     jlst::jls_options jo{};
     format->save(options.get_dest(0), input_image, jo);
 }
 
+// each worker creates its formats once and reuses them across jobs; the charls
+// decoder itself is created for every image:
+static bool decode_batch(jlst::djpls_options& options)
+{
+    struct worker_state
+    {
+        std::unique_ptr<jlst::format> jls_format;
+        std::string type;
+        std::unique_ptr<jlst::format> format;
+    };
+    auto& batch = options.get_batch();
+    std::vector<worker_state> workers(jlst::parallel::concurrency(options.jobs));
+    std::mutex cerr_mutex;
+    bool success = true;
+    jlst::parallel::for_each(batch.size(), options.jobs, [&](size_t index, unsigned int worker) {
+        auto& filenames = batch[index];
+        try
+        {
+            auto& state = workers[worker];
+            if (!state.jls_format)
+                state.jls_format.reset(jlst::factory::instance().get_format_from_type("jls"));
+            auto type = options.get_type().empty() ? jlst::djpls_options::compute_type_from_filename(filenames.second)
+                                                    : options.get_type();
+            if (!state.format || type != state.type)
+            {
+                state.format = get_format(type);
+                state.type = type;
+            }
+            jlst::source source(filenames.first);
+            jlst::image input_image;
+            if (is_striped(source))
+                input_image = jlst::jlss().load(source, input_image.get_image_info());
+            else
+                input_image = state.jls_format->load(source, input_image.get_image_info());
+            jlst::dest dest(filenames.second);
+            jlst::jls_options jo{};
+            state.format->save(dest, input_image, jo);
+        }
+        catch (std::exception& e)
+        {
+            std::lock_guard<std::mutex> lock(cerr_mutex);
+            std::cerr << "Error during decoding " << filenames.first << ": " << e.what() << std::endl;
+            success = false;
+        }
+    });
+    // the cached image buffers are of no use anymore:
+    jlst::block_pool::release();
+    return success;
+}
+
 int main(int argc, char* argv[])
 {
     jlst::djpls_options options{};
@@ -54,20 +119,25 @@ int main(int argc, char* argv[])
         return EXIT_FAILURE;
     }
 
+    bool success = true;
     try
     {
-        decode(options);
+        if (options.is_batch())
+            success = decode_batch(options);
+        else
+            decode(options);
     }
     catch (std::exception& e)
     {
         std::cerr << "Error during decoding: " << e.what() << std::endl;
-        return EXIT_FAILURE;
+        success = false;
     }
     catch (...)
     {
         std::cerr << "unknown exception during decoding" << std::endl;
-        return EXIT_FAILURE;
+        success = false;
     }
+    jlst::stats::report();
 
-    return EXIT_SUCCESS;
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
 }
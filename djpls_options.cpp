@@ -1,6 +1,7 @@
 // Copyright (c) Mathieu Malaterre
 // SPDX-License-Identifier: BSD-3-Clause
 #include "djpls_options.h"
+#include "stats.h"
 #include "tuple.h"
 
 #include "version.h"
@@ -26,6 +27,7 @@ bool djpls_options::process(int argc, char* argv[])
     std::vector<std::string> inputs{};
     std::vector<std::string> outputs{};
     std::string planar_configuration_str;
+    std::string stats_file;
     {
         namespace po = boost::program_options;
         po::options_description generic("Generic options (required when no redirects)");
@@ -34,6 +36,15 @@ bool djpls_options::process(int argc, char* argv[])
             ("output,o", po::value(&outputs) /*->required()*/, "Output filename.") // output
             ("type", po::value(&type_), "Output type (pgm, raw...).")              // output type
             ;
+
+        po::options_description batch("Batch options");
+        batch.add_options() //
+            ("batch", "Process each input/output pair as an independent job. "
+                      "Pairs are read as a NUL separated list from stdin when no input is given.") // batch
+            ("jobs,j", po::value(&jobs), "Number of worker threads, 0 for one per core (default 1).") // jobs
+            ("stats", "Print per-phase timing statistics to stderr.")                                 // stats
+            ("stats-file", po::value(&stats_file), "Write per-phase timing statistics as JSON to a file.") // stats
+            ;
         po::options_description image("Image output options");
         image.add_options() //
             ("planar_configuration,p", po::value(&planar_configuration_str),
@@ -45,6 +56,7 @@ bool djpls_options::process(int argc, char* argv[])
             ("version", "print version")                    // version
             ;
         desc.add(generic);
+        desc.add(batch);
         desc.add(image);
 
         po::positional_options_description p;
@@ -72,27 +84,40 @@ bool djpls_options::process(int argc, char* argv[])
         try
         {
             po::notify(vm);
-            if (vm.count("input"))
+            if (vm.count("stats") || vm.count("stats-file"))
+                stats::enable(stats_file);
+            if (vm.count("batch"))
             {
-                add_inputs(inputs);
+                // output type is computed for each job, unless specified:
+                if (vm.count("input"))
+                    add_batch(inputs, outputs);
+                else
+                    add_stdin_batch();
             }
             else
             {
-                add_stdin_input();
-            }
-
-            if (vm.count("output"))
-            {
-                add_outputs(outputs);
-            }
-            else
-            {
-                add_stdout_output();
-            }
-
-            if (!vm.count("type"))
-            {
-                type_ = compute_type_from_filenames(outputs);
+                if (vm.count("input"))
+                {
+                    add_inputs(inputs);
+                }
+                else
+                {
+                    add_stdin_input();
+                }
+
+                if (vm.count("output"))
+                {
+                    add_outputs(outputs);
+                }
+                else
+                {
+                    add_stdout_output();
+                }
+
+                if (!vm.count("type"))
+                {
+                    type_ = compute_type_from_filenames(outputs);
+                }
             }
         }
         catch (std::exception&)
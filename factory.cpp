@@ -3,6 +3,10 @@
 #include "factory.h"
 #include "format.h"
 #include "image.h"
+#include "source.h"
+#include "stats.h"
+
+#include <cstring>
 
 namespace jlst {
 bool factory::register_format(const format* f, float priority)
@@ -31,13 +35,44 @@ format* factory::get_format_from_type(std::string const& type) const
 
     return nullptr;
 }
+bool factory::register_signature(const format* f, std::string const& magic)
+{
+    signature sig;
+    sig.format_ = f;
+    sig.magic_ = magic;
+    signatures.push_back(sig);
+    if (magic.size() > max_signature_length)
+        max_signature_length = magic.size();
+    return true;
+}
 format* factory::detect_format(source& s) const
 {
+    // read the prefix once, all magic numbers are matched against it:
+    s.rewind();
+    const auto prefix = s.prefix(max_signature_length);
+    stats::scope scope(stats::detect);
+    for (auto e : formats)
+    {
+        for (auto& sig : signatures)
+        {
+            if (sig.format_ == e.format_ && prefix.size() >= sig.magic_.size() &&
+                std::memcmp(prefix.data(), sig.magic_.data(), sig.magic_.size()) == 0)
+            {
+                return e.format_->clone();
+            }
+        }
+    }
+
+    // formats without magic number (eg. raw), use the format specific detection:
     image_info ii{};
     for (auto e : formats)
     {
         auto f = e.format_;
-        if (f->detect(s, ii))
+        if (has_signature(f))
+            continue;
+        const bool found = f->detect(s, ii);
+        s.rewind();
+        if (found)
         {
             return f->clone();
         }
@@ -45,6 +80,15 @@ format* factory::detect_format(source& s) const
 
     return nullptr;
 }
+bool factory::has_signature(const format* f) const
+{
+    for (auto& sig : signatures)
+    {
+        if (sig.format_ == f)
+            return true;
+    }
+    return false;
+}
 factory& factory::instance()
 {
     static factory factory_;
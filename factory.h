@@ -4,6 +4,7 @@
 
 #include <set>
 #include <string>
+#include <vector>
 
 namespace jlst {
 class format;
@@ -13,10 +14,13 @@ class factory
 public:
     static factory& instance();
     bool register_format(const format* f, float priority = 0.5);
+    // magic number identifying a registered format, at offset 0 of the stream
+    bool register_signature(const format* f, std::string const& magic);
     format* get_format_from_type(std::string const& type) const;
     format* detect_format(source& s) const;
 
 private:
+    bool has_signature(const format* f) const;
     struct entry
     {
         const format* format_;
@@ -27,5 +31,12 @@ private:
         }
     };
     std::multiset<entry> formats;
+    struct signature
+    {
+        const format* format_;
+        std::string magic_;
+    };
+    std::vector<signature> signatures;
+    size_t max_signature_length{};
 };
 } // end namespace jlst
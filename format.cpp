@@ -3,6 +3,10 @@
 #include "format.h"
 #include "image.h"
 namespace jlst {
+bool format::detect(source&, image_info const&) const
+{
+    return false;
+}
 image format::load(jlst::source& source, image_info const& ii) const
 {
     image ret;
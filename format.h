@@ -18,7 +18,8 @@ public:
     }
     virtual format* clone() const = 0;
     virtual bool handle_type(std::string const& type) const = 0;
-    virtual bool detect(source& s, image_info const& ii) const = 0;
+    // detection for formats without a magic number (see factory::register_signature)
+    virtual bool detect(source& s, image_info const& ii) const;
 
     image load(source& s, image_info const& ii) const;
     void save(dest& d, image const& i, jls_options const& options) const;
@@ -0,0 +1,130 @@
+// Copyright (c) Mathieu Malaterre
+// SPDX-License-Identifier: BSD-3-Clause
+#include "hash_index.h"
+
+#include "crc32.h"
+#include "dest.h"
+#include "parallel.h"
+#include "source.h"
+#include "xxhash.h"
+
+#include <cstdio>  // std::snprintf
+#include <cstring> // std::memcmp
+#include <stdexcept>
+
+namespace jlst {
+// Sidecar layout, all integers little endian:
+//   char[8]  magic "JLSHIDX1"
+//   uint32   hash id (0: crc32, 1: xxh64)
+//   uint32   width
+//   uint32   height
+//   uint32   band height
+//   uint32   band count
+//   uint64   digest[band count]
+static const char magic[8] = {'J', 'L', 'S', 'H', 'I', 'D', 'X', '1'};
+
+static void put(std::vector<uint8_t>& out, uint64_t value, int size)
+{
+    for (int i = 0; i < size; ++i)
+        out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+static uint64_t get(const uint8_t* p, int size)
+{
+    uint64_t value = 0;
+    for (int i = size - 1; i >= 0; --i)
+        value = (value << 8) | p[i];
+    return value;
+}
+
+hash_index hash_index::compute(std::string const& hash, byte_buffer const& buffer, uint32_t width,
+                               uint32_t height, size_t row_size, int planes, uint32_t band_height, int jobs)
+{
+    if (hash != "crc32" && hash != "xxh64")
+        throw std::invalid_argument("hash: " + hash);
+    if (band_height == 0)
+        throw std::invalid_argument("band height: 0");
+    hash_index index;
+    index.hash = hash;
+    index.width = width;
+    index.height = height;
+    index.band_height = band_height;
+    const size_t nbands = (static_cast<size_t>(height) + band_height - 1) / band_height;
+    index.digests.resize(nbands);
+    const size_t plane_size = row_size * height;
+    if (buffer.size() < plane_size * static_cast<size_t>(planes))
+        throw std::invalid_argument("hash_index: buffer too small");
+
+    parallel::for_each(nbands, jobs, [&](size_t band, unsigned int) {
+        const size_t y = band * band_height;
+        const size_t offset = y * row_size;
+        const size_t size = (y + band_height > height ? height - y : band_height) * row_size;
+        // a band of a planar image is the same rows in every plane:
+        if (hash == "crc32")
+        {
+            uint32_t crc = 0;
+            for (int plane = 0; plane < planes; ++plane)
+                crc = crc32::update(crc, buffer.data() + plane * plane_size + offset, size);
+            index.digests[band] = crc;
+        }
+        else
+        {
+            xxh64 h;
+            for (int plane = 0; plane < planes; ++plane)
+                h.update(buffer.data() + plane * plane_size + offset, size);
+            index.digests[band] = h.digest();
+        }
+    });
+    return index;
+}
+
+std::string hash_index::to_string(size_t index) const
+{
+    char str[24];
+    if (hash == "crc32")
+        std::snprintf(str, sizeof str, "%8x", static_cast<unsigned int>(digests[index]));
+    else
+        std::snprintf(str, sizeof str, "%016llx", static_cast<unsigned long long>(digests[index]));
+    return str;
+}
+
+void hash_index::save(dest& d) const
+{
+    std::vector<uint8_t> out(magic, magic + sizeof magic);
+    put(out, hash == "crc32" ? 0 : 1, 4);
+    put(out, width, 4);
+    put(out, height, 4);
+    put(out, band_height, 4);
+    put(out, digests.size(), 4);
+    for (auto digest : digests)
+        put(out, digest, 8);
+    d.write(out.data(), out.size());
+}
+
+hash_index hash_index::load(source& s)
+{
+    const auto view = s.map();
+    const size_t header_size = 28;
+    if (view.size() < header_size || std::memcmp(view.data(), magic, sizeof magic) != 0)
+        throw std::invalid_argument("not a hash index: " + s.get_filename());
+    const uint8_t* header = view.data();
+    hash_index index;
+    const uint64_t id = get(header + 8, 4);
+    if (id > 1)
+        throw std::invalid_argument("hash index: unknown hash");
+    index.hash = id == 0 ? "crc32" : "xxh64";
+    index.width = static_cast<uint32_t>(get(header + 12, 4));
+    index.height = static_cast<uint32_t>(get(header + 16, 4));
+    index.band_height = static_cast<uint32_t>(get(header + 20, 4));
+    const uint64_t nbands = get(header + 24, 4);
+    if (index.band_height == 0 ||
+        nbands != (static_cast<size_t>(index.height) + index.band_height - 1) / index.band_height)
+        throw std::invalid_argument("hash index: inconsistent band count");
+    if (view.size() != header_size + 8 * nbands)
+        throw std::invalid_argument("hash index: truncated");
+    index.digests.resize(nbands);
+    for (size_t i = 0; i < nbands; ++i)
+        index.digests[i] = get(header + header_size + 8 * i, 8);
+    return index;
+}
+} // namespace jlst
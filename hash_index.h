@@ -0,0 +1,44 @@
+// Copyright (c) Mathieu Malaterre
+// SPDX-License-Identifier: BSD-3-Clause
+#pragma once
+
+#include "allocator.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace jlst {
+class source;
+class dest;
+
+/**
+ * Digests of the horizontal bands of a decoded image, so that a mismatch can
+ * be located instead of just detected. Band `i` covers rows
+ * [i * band_height, (i + 1) * band_height) of every plane.
+ */
+struct hash_index
+{
+    std::string hash{}; // "crc32" or "xxh64"
+    uint32_t width{};
+    uint32_t height{};
+    uint32_t band_height{};
+    std::vector<uint64_t> digests{};
+
+    /**
+     * `buffer` holds `planes` consecutive planes of `height` rows of
+     * `row_size` bytes (a single plane for interleaved images). Bands are
+     * hashed concurrently using `jobs` threads.
+     */
+    static hash_index compute(std::string const& hash, byte_buffer const& buffer, uint32_t width,
+                              uint32_t height, size_t row_size, int planes, uint32_t band_height, int jobs);
+
+    // digest of band `index` formatted like the whole image hash
+    std::string to_string(size_t index) const;
+
+    // binary sidecar, see hash_index.cpp for the layout
+    void save(dest& d) const;
+    static hash_index load(source& s);
+};
+} // namespace jlst
@@ -2,11 +2,12 @@
 // SPDX-License-Identifier: BSD-3-Clause
 #include "image.h"
 
+#include "kernels.h"
 #include "utils.h"
 
 #include <cassert>
-#include <cstring>   // memset
 #include <stdexcept> // for invalid_argument
+#include <utility>   // for swap
 
 namespace jlst {
 
@@ -46,217 +47,170 @@ void image::append(image const& other)
     }
 }
 
-std::vector<uint8_t> image::transform(charls::interleave_mode const& interleave_mode) const
+span<const uint8_t> image::transform(charls::interleave_mode const& interleave_mode,
+                                     byte_buffer& buffer) const
 {
-    auto& frame_info = get_image_info().frame_info();
-    if (frame_info.component_count == 1 || get_image_info().interleave_mode() == interleave_mode)
-        return get_image_data().pixel_data();
+    return transform(get_image_info(), get_image_data().view(), get_image_data().stride(), interleave_mode, buffer);
+}
+
+span<const uint8_t> image::transform(image_info const& info, span<const uint8_t> pixels, std::size_t stride,
+                                     charls::interleave_mode const& interleave_mode, byte_buffer& buffer)
+{
+    auto& frame_info = info.frame_info();
+    if (frame_info.component_count == 1 || info.interleave_mode() == interleave_mode)
+        return pixels;
     if (frame_info.component_count == 3)
     {
+        const size_t bytes_per_sample = (frame_info.bits_per_sample + 7) / 8;
         if (interleave_mode == charls::interleave_mode::none)
         {
-            assert(get_image_info().interleave_mode() == charls::interleave_mode::sample);
-            return utils::triplet_to_planar(get_image_data().pixel_data(), frame_info.width, frame_info.height,
-                                            frame_info.bits_per_sample, get_image_data().stride());
-        }
-        else if (interleave_mode == charls::interleave_mode::line)
-        {
-            if (get_image_info().interleave_mode() == charls::interleave_mode::sample)
-                return get_image_data().pixel_data();
-            assert(get_image_info().interleave_mode() == charls::interleave_mode::none);
-            return utils::planar_to_triplet(get_image_data().pixel_data(), frame_info.width, frame_info.height,
-                                            frame_info.bits_per_sample, get_image_data().stride());
+            assert(info.interleave_mode() == charls::interleave_mode::sample);
+            buffer.resize(3 * bytes_per_sample * frame_info.width * frame_info.height);
+            utils::triplet_to_planar(pixels.data(), buffer.data(), frame_info.width, frame_info.height,
+                                     frame_info.bits_per_sample, stride);
+            return span<const uint8_t>(buffer.data(), buffer.size());
         }
-        else if (interleave_mode == charls::interleave_mode::sample)
+        if (interleave_mode == charls::interleave_mode::line &&
+            info.interleave_mode() == charls::interleave_mode::sample)
+            return pixels;
+        if (interleave_mode == charls::interleave_mode::line || interleave_mode == charls::interleave_mode::sample)
         {
-            assert(get_image_info().interleave_mode() == charls::interleave_mode::none);
-            return utils::planar_to_triplet(get_image_data().pixel_data(), frame_info.width, frame_info.height,
-                                            frame_info.bits_per_sample, get_image_data().stride());
+            assert(info.interleave_mode() == charls::interleave_mode::none);
+            buffer.resize((stride ? stride : 3 * bytes_per_sample * frame_info.width) * frame_info.height);
+            utils::planar_to_triplet(pixels.data(), buffer.data(), frame_info.width, frame_info.height,
+                                     frame_info.bits_per_sample, stride);
+            return span<const uint8_t>(buffer.data(), buffer.size());
         }
     }
     throw std::invalid_argument("invalid transform request");
 }
 
-std::vector<uint8_t> image::crop(uint32_t X, uint32_t Y, uint32_t width, uint32_t height)
+// planar images are transformed one component plane at a time
+static void plane_layout(image const& i, size_t& planes, size_t& nbytes)
 {
-    assert(get_image_data().stride() == 0);
-    auto& frame_info = get_image_info().frame_info();
-    auto& inbuffer = get_image_data().pixel_data();
-    std::vector<uint8_t> out;
-    size_t nbytes = frame_info.component_count * ((frame_info.bits_per_sample + 7) / 8);
-    out.resize(width * height * nbytes);
-    auto inwidth = frame_info.width;
-    for (uint32_t y{}; y != frame_info.height; ++y)
+    auto& frame_info = i.get_image_info().frame_info();
+    const size_t sample_size = (frame_info.bits_per_sample + 7) / 8;
+    if (i.get_image_info().interleave_mode() == charls::interleave_mode::none)
     {
-        for (uint32_t x{}; x != frame_info.width; ++x)
-        {
-            if ((x >= X && x < X + width) && (y >= Y && y < Y + height))
-            {
-                std::memcpy(&out[(y - Y) * width * nbytes + (x - X) * nbytes], &inbuffer[y * inwidth * nbytes + x * nbytes],
-                            nbytes);
-            }
-        }
+        planes = frame_info.component_count;
+        nbytes = sample_size;
+    }
+    else
+    {
+        planes = 1;
+        nbytes = frame_info.component_count * sample_size;
     }
-    return out;
 }
-std::vector<uint8_t> image::flip(bool vertical)
+
+void image::crop(uint32_t X, uint32_t Y, uint32_t width, uint32_t height, int jobs)
 {
     assert(get_image_data().stride() == 0);
     auto& frame_info = get_image_info().frame_info();
-    auto& inbuffer = get_image_data().pixel_data();
-    std::vector<uint8_t> out;
-    out.resize(inbuffer.size());
-    size_t nbytes = frame_info.component_count * ((frame_info.bits_per_sample + 7) / 8);
-    auto inheigth = frame_info.height;
-    auto inwidth = frame_info.width;
-    if (vertical)
+    auto& pixel_data = get_image_data().pixel_data();
+    size_t planes, nbytes;
+    plane_layout(*this, planes, nbytes);
+    const size_t plane_size = static_cast<size_t>(frame_info.width) * frame_info.height * nbytes;
+    const size_t out_plane_size = static_cast<size_t>(width) * height * nbytes;
+    const bool inside = static_cast<size_t>(X) + width <= frame_info.width &&
+                        static_cast<size_t>(Y) + height <= frame_info.height;
+    if (inside && jobs == 1)
     {
-        for (uint32_t y{}; y != frame_info.height; ++y)
+        // rows move towards the start of the buffer, plane after plane:
+        for (size_t plane = 0; plane != planes; ++plane)
         {
-            std::memcpy(&out[y * inwidth * nbytes], &inbuffer[(inheigth - y - 1) * inwidth * nbytes], nbytes * inwidth);
+            kernels::crop(pixel_data.data() + plane * plane_size, pixel_data.data() + plane * out_plane_size,
+                          frame_info.width, frame_info.height, nbytes, X, Y, width, height);
         }
+        pixel_data.resize(planes * out_plane_size);
     }
     else
     {
-        // horizontal
-        for (uint32_t y{}; y != frame_info.height; ++y)
+        // the part of the region outside of the image is black:
+        byte_buffer out(planes * out_plane_size, 0);
+        for (size_t plane = 0; plane != planes; ++plane)
         {
-            for (uint32_t x{}; x != frame_info.width; ++x)
-            {
-                std::memcpy(&out[y * inwidth * nbytes + x * nbytes],
-                            &inbuffer[y * inwidth * nbytes + (inwidth - x - 1) * nbytes], nbytes);
-            }
+            kernels::crop(pixel_data.data() + plane * plane_size, out.data() + plane * out_plane_size,
+                          frame_info.width, frame_info.height, nbytes, X, Y, width, height, jobs);
         }
+        pixel_data.swap(out);
     }
-    return out;
+    frame_info.width = width;
+    frame_info.height = height;
 }
-std::vector<uint8_t> image::rotate(int degree)
+void image::flip(bool vertical, int jobs)
 {
-    assert(degree == 90 || degree == 180 || degree == 270);
     assert(get_image_data().stride() == 0);
     auto& frame_info = get_image_info().frame_info();
-    auto& inbuffer = get_image_data().pixel_data();
-    std::vector<uint8_t> out;
-    out.resize(inbuffer.size());
-    size_t nbytes = frame_info.component_count * ((frame_info.bits_per_sample + 7) / 8);
-    if (degree == 90)
-    {
-        auto oldheight = frame_info.height;
-        auto oldwidth = frame_info.width;
-        auto newheight = frame_info.width;
-        auto newwidth = frame_info.height;
-
-        for (uint32_t y{}; y != newheight; ++y)
-        {
-            for (uint32_t x{}; x != newwidth; ++x)
-            {
-                std::memcpy(&out[y * newwidth * nbytes + x * nbytes],
-                            &inbuffer[(oldheight - x - 1) * oldwidth * nbytes + y * nbytes], nbytes);
-            }
-        }
-    }
-    else if (degree == 180)
+    auto& pixel_data = get_image_data().pixel_data();
+    size_t planes, nbytes;
+    plane_layout(*this, planes, nbytes);
+    const size_t plane_size = static_cast<size_t>(frame_info.width) * frame_info.height * nbytes;
+    for (size_t plane = 0; plane != planes; ++plane)
     {
-        auto oldheight = frame_info.height;
-        auto oldwidth = frame_info.width;
-        for (uint32_t y{}; y != oldheight; ++y)
-        {
-            for (uint32_t x{}; x != oldwidth; ++x)
-            {
-                std::memcpy(&out[y * oldwidth * nbytes + x * nbytes],
-                            &inbuffer[(oldheight - y - 1) * oldwidth * nbytes + (oldwidth - x - 1) * nbytes], nbytes);
-            }
-        }
+        kernels::flip(pixel_data.data() + plane * plane_size, frame_info.width, frame_info.height, nbytes, vertical,
+                      jobs);
     }
-    else if (degree == 270)
+}
+// out(y, x) = in(reverse_x ? height - 1 - x : x, reverse_y ? width - 1 - y : y)
+static void transpose_planes(image& i, bool reverse_x, bool reverse_y, int jobs)
+{
+    auto& frame_info = i.get_image_info().frame_info();
+    auto& pixel_data = i.get_image_data().pixel_data();
+    byte_buffer out(pixel_data.size());
+    size_t planes, nbytes;
+    plane_layout(i, planes, nbytes);
+    const size_t plane_size = static_cast<size_t>(frame_info.width) * frame_info.height * nbytes;
+    for (size_t plane = 0; plane != planes; ++plane)
     {
-        auto oldheight = frame_info.height;
-        auto oldwidth = frame_info.width;
-        auto newheight = frame_info.width;
-        auto newwidth = frame_info.height;
-
-        for (uint32_t y{}; y != newheight; ++y)
-        {
-            for (uint32_t x{}; x != newwidth; ++x)
-            {
-                std::memcpy(&out[y * newwidth * nbytes + x * nbytes],
-                            &inbuffer[x * oldwidth * nbytes + (oldwidth - y - 1) * nbytes], nbytes);
-            }
-        }
+        kernels::transpose(pixel_data.data() + plane * plane_size, out.data() + plane * plane_size, frame_info.width,
+                           frame_info.height, nbytes, reverse_x, reverse_y, jobs);
     }
-    return out;
+    pixel_data.swap(out);
+    std::swap(frame_info.width, frame_info.height);
 }
-std::vector<uint8_t> image::transpose()
+
+void image::rotate(int degree, int jobs)
 {
+    assert(degree == 90 || degree == 180 || degree == 270);
     assert(get_image_data().stride() == 0);
-    auto& frame_info = get_image_info().frame_info();
-    auto& inbuffer = get_image_data().pixel_data();
-    std::vector<uint8_t> out;
-    out.resize(inbuffer.size());
-    size_t nbytes = frame_info.component_count * ((frame_info.bits_per_sample + 7) / 8);
-
-    auto oldheight = frame_info.height;
-    auto oldwidth = frame_info.width;
-    auto newheight = frame_info.width;
-    auto newwidth = frame_info.height;
+    if (degree == 90)
+        return transpose_planes(*this, true, false, jobs);
+    if (degree == 270)
+        return transpose_planes(*this, false, true, jobs);
 
-    for (uint32_t y{}; y != newheight; ++y)
+    auto& frame_info = get_image_info().frame_info();
+    auto& pixel_data = get_image_data().pixel_data();
+    size_t planes, nbytes;
+    plane_layout(*this, planes, nbytes);
+    const size_t plane_size = static_cast<size_t>(frame_info.width) * frame_info.height * nbytes;
+    for (size_t plane = 0; plane != planes; ++plane)
     {
-        for (uint32_t x{}; x != newwidth; ++x)
-        {
-            std::memcpy(&out[y * newwidth * nbytes + x * nbytes], &inbuffer[x * oldwidth * nbytes + y * nbytes], nbytes);
-        }
+        kernels::rotate180(pixel_data.data() + plane * plane_size, frame_info.width, frame_info.height, nbytes, jobs);
     }
-    return out;
 }
-std::vector<uint8_t> image::transverse()
+void image::transpose(int jobs)
 {
     assert(get_image_data().stride() == 0);
-    auto& frame_info = get_image_info().frame_info();
-    auto& inbuffer = get_image_data().pixel_data();
-    std::vector<uint8_t> out;
-    out.resize(inbuffer.size());
-    size_t nbytes = frame_info.component_count * ((frame_info.bits_per_sample + 7) / 8);
-
-    auto oldheight = frame_info.height;
-    auto oldwidth = frame_info.width;
-    auto newheight = frame_info.width;
-    auto newwidth = frame_info.height;
-
-    for (uint32_t y{}; y != newheight; ++y)
-    {
-        for (uint32_t x{}; x != newwidth; ++x)
-        {
-            std::memcpy(&out[y * newwidth * nbytes + x * nbytes],
-                        &inbuffer[(oldheight - x - 1) * oldwidth * nbytes + (oldwidth - y - 1) * nbytes], nbytes);
-        }
-    }
-    return out;
+    transpose_planes(*this, false, false, jobs);
+}
+void image::transverse(int jobs)
+{
+    assert(get_image_data().stride() == 0);
+    transpose_planes(*this, true, true, jobs);
 }
-std::vector<uint8_t> image::wipe(uint32_t X, uint32_t Y, uint32_t width, uint32_t height)
+void image::wipe(uint32_t X, uint32_t Y, uint32_t width, uint32_t height, int jobs)
 {
     assert(get_image_data().stride() == 0);
     auto& frame_info = get_image_info().frame_info();
-    auto& inbuffer = get_image_data().pixel_data();
-    std::vector<uint8_t> out;
-    out.resize(inbuffer.size());
-    size_t nbytes = frame_info.component_count * ((frame_info.bits_per_sample + 7) / 8);
-    auto inwidth = frame_info.width;
-    for (uint32_t y{}; y != frame_info.height; ++y)
+    auto& pixel_data = get_image_data().pixel_data();
+    size_t planes, nbytes;
+    plane_layout(*this, planes, nbytes);
+    const size_t plane_size = static_cast<size_t>(frame_info.width) * frame_info.height * nbytes;
+    for (size_t plane = 0; plane != planes; ++plane)
     {
-        for (uint32_t x{}; x != frame_info.width; ++x)
-        {
-            if ((x >= X && x < X + width) && (y >= Y && y < Y + height))
-            {
-                std::memset(&out[y * inwidth * nbytes + x * nbytes], 0, nbytes);
-            }
-            else
-            {
-                std::memcpy(&out[y * inwidth * nbytes + x * nbytes], &inbuffer[y * inwidth * nbytes + x * nbytes], nbytes);
-            }
-        }
+        uint8_t* data = pixel_data.data() + plane * plane_size;
+        kernels::wipe(data, data, frame_info.width, frame_info.height, nbytes, X, Y, width, height, jobs);
     }
-    return out;
 }
 
 } // namespace jlst
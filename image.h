@@ -2,6 +2,9 @@
 // SPDX-License-Identifier: BSD-3-Clause
 #pragma once
 
+#include "allocator.h"
+#include "span.h"
+
 #include <charls/public_types.h> // for frame_info, interleave_mode, charls...
 #include <cstddef>               // for size_t
 #include <cstdint>               // for uint8_t
@@ -48,7 +51,7 @@ public:
 class image_data
 {
     std::size_t stride_{};
-    std::vector<uint8_t> pixel_data_{};
+    byte_buffer pixel_data_{};
 
 public:
     void append(image_data const& id);
@@ -61,14 +64,18 @@ public:
         return stride_;
     }
 
-    std::vector<uint8_t>& pixel_data()
+    byte_buffer& pixel_data()
     {
         return pixel_data_;
     }
-    const std::vector<uint8_t>& pixel_data() const
+    const byte_buffer& pixel_data() const
     {
         return pixel_data_;
     }
+    span<const uint8_t> view() const
+    {
+        return span<const uint8_t>(pixel_data_.data(), pixel_data_.size());
+    }
 };
 
 class image
@@ -99,14 +106,29 @@ public:
 
     void append(image const& other);
 
-    std::vector<uint8_t> transform(charls::interleave_mode const& interleave_mode) const;
-
-    std::vector<uint8_t> crop(uint32_t X, uint32_t Y, uint32_t width, uint32_t height);
-    std::vector<uint8_t> flip(bool vertical); // horizontal when false
-    std::vector<uint8_t> rotate(int degree);
-    std::vector<uint8_t> transpose();
-    std::vector<uint8_t> transverse();
-    std::vector<uint8_t> wipe(uint32_t X, uint32_t Y, uint32_t width, uint32_t height);
+    /**
+     * Pixel data in `interleave_mode`: a view of the pixel data when it is
+     * already laid out this way, otherwise the pixel data converted into
+     * `buffer`. The view is valid as long as the image and `buffer` are.
+     */
+    span<const uint8_t> transform(charls::interleave_mode const& interleave_mode, byte_buffer& buffer) const;
+    // same, for the pixels of `info` viewed by `pixels` (eg. a band of rows of another image)
+    static span<const uint8_t> transform(image_info const& info, span<const uint8_t> pixels, std::size_t stride,
+                                         charls::interleave_mode const& interleave_mode, byte_buffer& buffer);
+
+    /**
+     * Geometric transforms, applied to the pixel data in place (the frame info
+     * is updated) using `jobs` threads, 0 for one per core. Transposes,
+     * rotations by 90/270 and crops (other than single threaded crops of a
+     * region inside the image) go through one temporary buffer, which then
+     * replaces the pixel data.
+     */
+    void crop(uint32_t X, uint32_t Y, uint32_t width, uint32_t height, int jobs = 1);
+    void flip(bool vertical, int jobs = 1); // horizontal when false
+    void rotate(int degree, int jobs = 1);
+    void transpose(int jobs = 1);
+    void transverse(int jobs = 1);
+    void wipe(uint32_t X, uint32_t Y, uint32_t width, uint32_t height, int jobs = 1);
 };
 
 } // namespace jlst
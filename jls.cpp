@@ -6,6 +6,7 @@
 #include "factory.h"
 #include "image.h"
 #include "jplstran_options.h"
+#include "stats.h"
 #include "utils.h"
 
 #include <cassert>
@@ -18,24 +19,6 @@ bool jls::handle_type(std::string const& type) const
 {
     return type == "jls";
 }
-bool jls::detect(source& s, image_info const&) const
-{
-    try
-    {
-        charls::jpegls_decoder decoder;
-        std::vector<uint8_t> buf;
-        buf.resize(64 * 2);
-        s.read(buf.data(), buf.size());
-        decoder.source(buf);
-        decoder.read_header();
-        return true;
-    }
-    catch (std::exception& e)
-    {
-    }
-    return false;
-}
-
 static bool charls_jpegls_is_spiff_consistent_with_frame_info(const charls_spiff_header* spiff_header,
                                                               const charls_frame_info* frame_info)
 {
@@ -110,14 +93,155 @@ static void examine_app14(const unsigned char* data, size_t len)
 }
 #endif
 
+span<const uint8_t> jls::read_header_bytes(source& s)
+{
+    // most headers (SPIFF + SOF55 + SOS) fit in the first window:
+    size_t window = 256;
+    auto view = s.prefix(window);
+    if (view.size() < 2 || view[0] != 0xff || view[1] != 0xd8)
+        throw std::invalid_argument("missing SOI marker");
+    size_t pos = 2;
+    for (;;)
+    {
+        // marker (fill bytes allowed) and segment length:
+        while (pos + 4 > view.size() || (view[pos] == 0xff && view[pos + 1] == 0xff))
+        {
+            if (pos + 4 <= view.size())
+            {
+                ++pos; // fill byte
+                continue;
+            }
+            if (view.size() < window)
+                throw std::invalid_argument("truncated header");
+            window *= 2;
+            view = s.prefix(window);
+        }
+        if (view[pos] != 0xff)
+            throw std::invalid_argument("invalid marker in header");
+        const uint8_t marker = view[pos + 1];
+        pos += 2;
+        // markers without a segment: TEM, RSTn
+        if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd7))
+            continue;
+        const size_t length = static_cast<size_t>(view[pos] << 8 | view[pos + 1]);
+        if (length < 2)
+            throw std::invalid_argument("invalid segment length in header");
+        pos += length;
+        if (marker == 0xda) // SOS
+            break;
+    }
+    while (view.size() < pos)
+    {
+        if (view.size() < window)
+            throw std::invalid_argument("truncated header");
+        window *= 2;
+        view = s.prefix(window);
+    }
+    return view.subspan(0, pos);
+}
+
+bool jls::has_jpegls_frame(source& s)
+{
+    s.rewind();
+    bool found = false;
+    try
+    {
+        const auto header = read_header_bytes(s);
+        // complete segments, walked as in read_header_bytes:
+        size_t pos = 2;
+        while (pos + 2 <= header.size())
+        {
+            if (header[pos + 1] == 0xff)
+            {
+                ++pos; // fill byte
+                continue;
+            }
+            const uint8_t marker = header[pos + 1];
+            pos += 2;
+            if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd7))
+                continue;
+            if (pos + 2 > header.size())
+                break;
+            // the first frame header decides (SOF0..SOF15 are other JPEG processes):
+            if (marker == 0xf7)
+            {
+                found = true;
+                break;
+            }
+            if (marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc)
+                break;
+            pos += static_cast<size_t>(header[pos] << 8 | header[pos + 1]);
+        }
+    }
+    catch (std::exception&)
+    {
+        found = false;
+    }
+    s.rewind();
+    return found;
+}
+
+std::vector<size_t> jls::scan_sizes(span<const uint8_t> stream)
+{
+    const uint8_t* data = stream.data();
+    const size_t size = stream.size();
+    if (size < 2 || data[0] != 0xff || data[1] != 0xd8)
+        throw std::invalid_argument("missing SOI marker");
+    std::vector<size_t> sizes;
+    size_t pos = 2;
+    while (pos + 2 <= size)
+    {
+        if (data[pos] != 0xff)
+            throw std::invalid_argument("invalid marker");
+        const uint8_t marker = data[pos + 1];
+        if (marker == 0xff)
+        {
+            ++pos; // fill byte
+            continue;
+        }
+        pos += 2;
+        if (marker == 0xd9) // EOI
+            break;
+        // markers without a segment: TEM, RSTn
+        if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd7))
+            continue;
+        if (pos + 2 > size)
+            throw std::invalid_argument("truncated segment");
+        const size_t length = static_cast<size_t>(data[pos] << 8 | data[pos + 1]);
+        if (length < 2 || pos + length > size)
+            throw std::invalid_argument("invalid segment length");
+        pos += length;
+        if (marker != 0xda) // SOS
+            continue;
+        // bit stuffing: a 0xff of the scan data is followed by a byte with its
+        // high bit clear, any other 0xff starts a marker (RSTn are part of the scan)
+        const size_t start = pos;
+        for (;;)
+        {
+            const void* ff = std::memchr(data + pos, 0xff, size - pos);
+            if (!ff)
+            {
+                pos = size;
+                break;
+            }
+            pos = static_cast<size_t>(static_cast<const uint8_t*>(ff) - data);
+            if (pos + 1 < size && (data[pos + 1] & 0x80) && !(data[pos + 1] >= 0xd0 && data[pos + 1] <= 0xd7))
+                break;
+            ++pos;
+        }
+        sizes.push_back(pos - start);
+    }
+    return sizes;
+}
+
 void jls::read_info(source& fs, image& i) const
 {
     fs.rewind();
     charls::jpegls_decoder decoder;
-    std::vector<uint8_t> buf;
-    buf.resize(64 * 2); // SPIFF header need a bit more than 64 bytes
-    fs.read(buf.data(), buf.size());
-    decoder.source(buf);
+    // only the header segments are read, whatever the size of COM/APPn:
+    const auto header = read_header_bytes(fs);
+    stats::scope scope(stats::header, header.size());
+    decoder.source(header);
     // comment handling, must be setup before any read_* function
     std::string comment;
 #if CHARLS_VERSION_MAJOR > 2 || (CHARLS_VERSION_MAJOR == 2 && CHARLS_VERSION_MINOR > 2)
@@ -169,9 +293,10 @@ void jls::read_info(source& fs, image& i) const
 }
 
 namespace {
-static void decompress(charls::jpegls_decoder& decoder, source& fs, image& i)
+// `encoded_source` must outlive the decoder
+static void decompress(charls::jpegls_decoder& decoder, span<const uint8_t> encoded_source, image& i)
 {
-    const std::vector<uint8_t> encoded_source = fs.read_bytes();
+    stats::scope scope(stats::decode, encoded_source.size());
     decoder.source(encoded_source);
     // comment handling, must be setup before any read_* function
     std::string comment;
@@ -192,6 +317,7 @@ static void decompress(charls::jpegls_decoder& decoder, source& fs, image& i)
     auto& decoded_buffer = i.get_image_data().pixel_data();
     decoded_buffer.resize(decoder.destination_size());
     decoder.decode(decoded_buffer);
+    scope.bytes_out(decoded_buffer.size());
 }
 } // end namespace
 
@@ -199,13 +325,17 @@ void jls::read_data(source& fs, image& i) const
 {
     fs.rewind();
     charls::jpegls_decoder decoder;
-    decompress(decoder, fs, i);
+    // zero-copy view of the input stream:
+    decompress(decoder, fs.map(), i);
 }
 
 namespace {
-static std::vector<uint8_t> compress(image const& img, const jlst::jls_options& options)
+// encode into the `reserve(estimated_size)` buffer, returns the encoded size
+template<typename Reserve>
+static size_t compress(image_info const& info, span<const uint8_t> pixels, size_t stride,
+                       const jlst::jls_options& options, Reserve reserve)
 {
-    auto const& frame_info = img.get_image_info().frame_info();
+    auto const& frame_info = info.frame_info();
     // what if user requested 'line' or 'sample' for single component ? Let's
     // handle it here (not sure why charls does not handle it internally).
     // `jpeg` seems to handle line/sample for single input...not clear what is legal
@@ -214,7 +344,7 @@ static std::vector<uint8_t> compress(image const& img, const jlst::jls_options&
         if (options.interleave_mode != charls::interleave_mode::none)
             throw std::invalid_argument("Invalid interleave_mode for single component. Use 'none'");
     }
-    auto interleave_mode = img.get_image_info().interleave_mode();
+    auto interleave_mode = info.interleave_mode();
     if (options.has_interleave_mode)
     {
         // user wants to override default interleave mode:
@@ -253,9 +383,8 @@ static std::vector<uint8_t> compress(image const& img, const jlst::jls_options&
     // setup encoder using input image:
     encoder.frame_info(frame_info); // frame_info
 
-    // allocate output:
-    std::vector<uint8_t> buffer(encoder.estimated_destination_size());
-    encoder.destination(buffer);
+    const size_t estimated_size = encoder.estimated_destination_size();
+    encoder.destination(reserve(estimated_size), estimated_size);
     // now that destination buffer is set, write SPIFF header:
     if (options.standard_spiff_header)
     {
@@ -269,7 +398,7 @@ static std::vector<uint8_t> compress(image const& img, const jlst::jls_options&
     {
         // the following writes an extra \0
         // encoder.write_comment(image.get_image_info().comment().c_str());
-        auto& comment = img.get_image_info().comment();
+        auto& comment = info.comment();
         if (!comment.empty())
             encoder.write_comment(comment.c_str(), comment.size());
     }
@@ -288,7 +417,14 @@ static std::vector<uint8_t> compress(image const& img, const jlst::jls_options&
     (void)coltra_none;
 #endif
 
-    const auto transform_pixel_data{img.transform(interleave_mode)};
+    // no copy when the pixel data is already in the requested interleave mode:
+    byte_buffer buffer;
+    span<const uint8_t> transform_pixel_data;
+    {
+        stats::scope scope(stats::transform, pixels.size());
+        transform_pixel_data = image::transform(info, pixels, stride, interleave_mode, buffer);
+    }
+    stats::scope scope(stats::encode, transform_pixel_data.size());
     size_t encoded_size;
     if (interleave_mode == charls::interleave_mode::none)
     {
@@ -296,11 +432,11 @@ static std::vector<uint8_t> compress(image const& img, const jlst::jls_options&
     }
     else
     {
-        encoded_size = encoder.encode(transform_pixel_data, img.get_image_data().stride());
+        encoded_size = encoder.encode(transform_pixel_data, stride);
     }
-    buffer.resize(encoded_size);
+    scope.bytes_out(encoded_size);
 
-    return buffer;
+    return encoded_size;
 }
 } // end namespace
 
@@ -310,13 +446,31 @@ void jls::write_info(dest&, const image&, const jls_options&) const
 
 void jls::write_data(dest& fs, const image& i, const jls_options& jo) const
 {
-    auto encoded_buffer{compress(i, jo)};
-    fs.write(encoded_buffer.data(), encoded_buffer.size());
+    // encode straight into the destination stream (memory-mapped when possible):
+    const size_t encoded_size = compress(i.get_image_info(), i.get_image_data().view(), i.get_image_data().stride(),
+                                         jo, [&fs](size_t n) { return fs.reserve(n); });
+    fs.commit(encoded_size);
+}
+
+void jls::encode(const image& i, const jls_options& jo, byte_buffer& buffer)
+{
+    encode(i.get_image_info(), i.get_image_data().view(), i.get_image_data().stride(), jo, buffer);
+}
+
+void jls::encode(const image_info& info, span<const uint8_t> pixels, size_t stride, const jls_options& jo,
+                 byte_buffer& buffer)
+{
+    const size_t encoded_size = compress(info, pixels, stride, jo, [&buffer](size_t n) {
+        buffer.resize(n);
+        return buffer.data();
+    });
+    buffer.resize(encoded_size);
 }
 
 namespace {
 // find the *first* matching marker
-static size_t find_marker(std::vector<uint8_t>& v, uint8_t marker)
+template<typename Container>
+static size_t find_marker(const Container& v, uint8_t marker)
 {
     size_t pos = 0;
     for (auto it = v.begin(); it != v.end(); ++it)
@@ -337,15 +491,6 @@ static size_t find_marker(std::vector<uint8_t>& v, uint8_t marker)
     return pos;
 }
 
-static void patch_header(std::vector<uint8_t>& v, int near)
-{
-    auto pos = find_marker(v, 0xda);
-    // Ls:
-    uint16_t ls = v[pos + 0] << 8 | v[pos + 1];
-    (void)ls;
-
-    v[pos + 9] = near;
-}
 } // end namespace
 
 void jls::fix_jai(dest& d, source& s) const
@@ -417,12 +562,13 @@ void jls::fix_jai(dest& d, source& s) const
         throw std::runtime_error("Unsupported bits per sample");
     }
     s.rewind();
-    std::vector<uint8_t> encoded_source = s.read_bytes();
+    const auto encoded_source = s.map();
     auto pos = find_marker(encoded_source, 0xda);
     assert(pos == 0x0F + 2);
-    encoded_source.insert(encoded_source.begin() + pos - 2, marker_lse, marker_lse + 15);
-
-    d.write(encoded_source.data(), encoded_source.size());
+    // insert LSE right before SOS, without copying the input stream:
+    d.write(encoded_source.data(), pos - 2);
+    d.write(marker_lse, 15);
+    d.write(encoded_source.data() + pos - 2, encoded_source.size() - (pos - 2));
 }
 
 void jls::fix_spiff(dest& d, source& s) const
@@ -432,33 +578,36 @@ void jls::fix_spiff(dest& d, source& s) const
     auto& frame_info = input_image.get_image_info().frame_info();
 
     s.rewind();
-    std::vector<uint8_t> encoded_source = s.read_bytes();
+    const auto encoded_source = s.map();
     auto pos = find_marker(encoded_source, 0xda);
     //    assert(pos == 0x0F + 2);
 
+    // only the SOI and SPIFF header are written, no image is encoded:
     charls::jpegls_encoder encoder;
     encoder.frame_info(frame_info);
-    std::vector<uint8_t> buffer(encoder.estimated_destination_size());
-    std::vector<uint8_t> inbuffer(encoder.estimated_destination_size());
-    encoder.destination(buffer);
+    uint8_t header[64];
+    encoder.destination(header, sizeof header);
     const charls::spiff_color_space spiff_color_space =
         frame_info.component_count == 1 ? charls::spiff_color_space::grayscale : charls::spiff_color_space::rgb;
     encoder.write_standard_spiff_header(spiff_color_space);
-    // encode a black image for now. See:
-    // https://github.com/team-charls/charls/issues/187
-    encoder.encode(inbuffer);
-    auto spiff_start = find_marker(buffer, 0xe8);
-    const auto spiff_header = &buffer[0] + spiff_start - 2;
-    encoded_source.insert(encoded_source.begin() + 2, spiff_header, spiff_header + 34 + 10);
-
-    d.write(encoded_source.data(), encoded_source.size());
+    const size_t spiff_header_size = 34;
+    if (encoder.bytes_written() != 2 + spiff_header_size)
+        throw std::runtime_error("unexpected SPIFF header size");
+    // SPIFF end of directory entry, followed by the SOI of the JPEG-LS stream:
+    static const uint8_t end_of_directory[10] = {0xFF, 0xE8, 0x00, 0x08, 0x00, 0x00, 0x00, 0x01, 0xFF, 0xD8};
+    // insert SPIFF header right after SOI:
+    d.write(encoded_source.data(), 2);
+    d.write(header + 2, spiff_header_size);
+    d.write(end_of_directory, sizeof end_of_directory);
+    d.write(encoded_source.data() + 2, encoded_source.size() - 2);
 }
 
-void jls::transform(dest& d, source& s, const tran_options& to) const
+jls_options jls::get_options(charls::jpegls_decoder const& decoder)
 {
-    jlst::image input_image;
-    charls::jpegls_decoder decoder;
-    decompress(decoder, s, input_image);
+    if (decoder.near_lossless() != 0)
+    {
+        throw std::runtime_error("near lossless not handled");
+    }
 
     jls_options jo{};
     jo.interleave_mode = decoder.interleave_mode();
@@ -466,64 +615,41 @@ void jls::transform(dest& d, source& s, const tran_options& to) const
     jo.preset_coding_parameters = decoder.preset_coding_parameters();
     jo.color_transformation = decoder.color_transformation();
     jo.standard_spiff_header = decoder.spiff_header_has_value();
+    return jo;
+}
 
-    jlst::image output_image;
+void jls::apply(image& i, const tran_options& to)
+{
+    stats::scope scope(stats::transform, i.get_image_data().pixel_data().size());
+    auto& region = to.region;
     if (to.type == tran_options::transform_type::crop)
-    {
-        output_image.get_image_info() = input_image.get_image_info();
-        auto& region = to.region;
-        output_image.get_image_info().frame_info().width = region.Width;
-        output_image.get_image_info().frame_info().height = region.Height;
-        output_image.get_image_data().pixel_data() = input_image.crop(region.X, region.Y, region.Width, region.Height);
-    }
+        i.crop(region.X, region.Y, region.Width, region.Height, to.jobs);
     else if (to.type == tran_options::transform_type::flip)
-    {
-        output_image.get_image_info() = input_image.get_image_info();
-        output_image.get_image_data().pixel_data() = input_image.flip(to.vertical);
-    }
+        i.flip(to.vertical, to.jobs);
     else if (to.type == tran_options::transform_type::rotate)
-    {
-        output_image.get_image_info() = input_image.get_image_info();
-        if (to.degree == 90 || to.degree == 270)
-        {
-            output_image.get_image_info().frame_info().width = input_image.get_image_info().frame_info().height;
-            output_image.get_image_info().frame_info().height = input_image.get_image_info().frame_info().width;
-        }
-        output_image.get_image_data().pixel_data() = input_image.rotate(to.degree);
-    }
+        i.rotate(to.degree, to.jobs);
     else if (to.type == tran_options::transform_type::transpose)
-    {
-        output_image.get_image_info() = input_image.get_image_info();
-        output_image.get_image_info().frame_info().width = input_image.get_image_info().frame_info().height;
-        output_image.get_image_info().frame_info().height = input_image.get_image_info().frame_info().width;
-
-        output_image.get_image_data().pixel_data() = input_image.transpose();
-    }
+        i.transpose(to.jobs);
     else if (to.type == tran_options::transform_type::transverse)
-    {
-        output_image.get_image_info() = input_image.get_image_info();
-        output_image.get_image_info().frame_info().width = input_image.get_image_info().frame_info().height;
-        output_image.get_image_info().frame_info().height = input_image.get_image_info().frame_info().width;
-
-        output_image.get_image_data().pixel_data() = input_image.transverse();
-    }
+        i.transverse(to.jobs);
     else if (to.type == tran_options::transform_type::wipe)
-    {
-        output_image.get_image_info() = input_image.get_image_info();
-        auto& region = to.region;
-        output_image.get_image_data().pixel_data() = input_image.wipe(region.X, region.Y, region.Width, region.Height);
-    }
+        i.wipe(region.X, region.Y, region.Width, region.Height, to.jobs);
     else
-    {
         throw std::runtime_error("wotsit");
-    }
-    auto encoded_buffer{compress(output_image, jo)};
-    if (decoder.near_lossless() != 0)
-    {
-        throw std::runtime_error("near lossless not handled");
-        patch_header(encoded_buffer, decoder.near_lossless());
-    }
-    d.write(encoded_buffer.data(), encoded_buffer.size());
+}
+
+void jls::transform(dest& d, source& s, const tran_options& to) const
+{
+    jlst::image input_image;
+    charls::jpegls_decoder decoder;
+    s.rewind();
+    const auto encoded_source = s.map();
+    decompress(decoder, encoded_source, input_image);
+    const jls_options jo = get_options(decoder);
+    // the decoded buffer is transformed in place, then handed to the encoder
+    // as is (same interleave mode), and encoded straight into `d`:
+    apply(input_image, to);
+    write_data(d, input_image, jo);
 }
 
 format* jls::clone() const
@@ -537,4 +663,6 @@ static const format* get()
     return &jls_;
 }
 static bool b = factory::instance().register_format(get(), 1);
+// SOI followed by any marker (SPIFF APP8, SOF55, LSE, COM...):
+static bool s = factory::instance().register_signature(get(), "\xFF\xD8\xFF");
 } // namespace jlst
@@ -1,10 +1,15 @@
 // Copyright (c) Mathieu Malaterre
 // SPDX-License-Identifier: BSD-3-Clause
 #pragma once
+#include "allocator.h"
 #include "format.h"
+#include "span.h"
 
 #include <charls/charls.h>
 
+#include <cstdint>
+#include <vector>
+
 namespace jlst {
 class tran_options;
 class jls : public format
@@ -12,7 +17,6 @@ class jls : public format
 public:
     format* clone() const override;
     bool handle_type(std::string const& type) const override;
-    bool detect(source& s, image_info const& ii) const override;
 
     void read_info(source& s, image& i) const override;
     void read_data(source& s, image& i) const override;
@@ -24,8 +28,36 @@ public:
     void fix_jai(dest& d, source& s) const;
     void fix_spiff(dest& d, source& s) const;
 
-private:
-    charls::jpegls_decoder decoder_;
-    charls::jpegls_encoder encoder_;
+    /**
+     * Returns a view of the header segments, from SOI up to and including the
+     * SOS segment, starting at the current position of `s`. Only the bytes
+     * needed are read: the read window grows geometrically while markers are
+     * walked. The size of the view is the number of bytes consumed. The view
+     * is invalidated by the next read on `s`.
+     */
+    static span<const uint8_t> read_header_bytes(source& s);
+    /**
+     * Returns true when the header segments of `s` hold a JPEG-LS frame
+     * (SOF55), false for any other JPEG or an unparsable header. `s` is
+     * rewound.
+     */
+    static bool has_jpegls_frame(source& s);
+    /**
+     * Returns the size in bytes of the entropy coded data (restart markers
+     * included) of each scan of the whole codestream `stream`, in order. The
+     * markers are walked and the scan data is only searched for the next
+     * marker, it is never decoded. A missing EOI marker ends the last scan.
+     */
+    static std::vector<size_t> scan_sizes(span<const uint8_t> stream);
+
+    // encodes `i` in memory, `buffer` is resized to the encoded size
+    static void encode(const image& i, const jls_options& jo, byte_buffer& buffer);
+    // same, for the pixels of `info` viewed by `pixels` (rows `stride` bytes apart, 0 when packed)
+    static void encode(const image_info& info, span<const uint8_t> pixels, size_t stride, const jls_options& jo,
+                       byte_buffer& buffer);
+    // encoding parameters reproducing the (lossless) codestream read by `decoder`
+    static jls_options get_options(charls::jpegls_decoder const& decoder);
+    // applies the geometric transform requested on the jplstran command line, in place, on `to.jobs` threads
+    static void apply(image& i, const tran_options& to);
 };
 } // namespace jlst
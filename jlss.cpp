@@ -0,0 +1,305 @@
+// Copyright (c) Mathieu Malaterre
+// SPDX-License-Identifier: BSD-3-Clause
+#include "jlss.h"
+
+#include "cjpls_options.h"
+#include "dest.h"
+#include "factory.h"
+#include "image.h"
+#include "jls.h"
+#include "jplstran_options.h"
+#include "parallel.h"
+#include "source.h"
+#include "span.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace jlst {
+// Striped container, all integers little endian:
+//   char[8]  magic "JLSSTRIP"
+//   uint32   width
+//   uint32   height
+//   uint32   rows per stripe (the last stripe may be shorter)
+//   uint32   stripe count
+//   uint64   offset[stripe count + 1], from the start of the stream, the last
+//            one being the size of the stream
+//   stripes, each one a complete JPEG-LS codestream (SOI ... EOI). Only the
+//   first stripe holds the comment.
+static const char magic[8] = {'J', 'L', 'S', 'S', 'T', 'R', 'I', 'P'};
+static const size_t header_size = 24;
+
+namespace {
+struct stripe_index
+{
+    uint32_t width{};
+    uint32_t height{};
+    uint32_t rows{};
+    std::vector<size_t> offsets{};
+
+    size_t count() const
+    {
+        return offsets.size() - 1;
+    }
+    span<const uint8_t> stripe(span<const uint8_t> stream, size_t k) const
+    {
+        return stream.subspan(offsets[k], offsets[k + 1] - offsets[k]);
+    }
+};
+
+void put(std::vector<uint8_t>& out, uint64_t value, int size)
+{
+    for (int i = 0; i < size; ++i)
+        out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+uint64_t get(const uint8_t* p, int size)
+{
+    uint64_t value = 0;
+    for (int i = size - 1; i >= 0; --i)
+        value = (value << 8) | p[i];
+    return value;
+}
+
+stripe_index parse(span<const uint8_t> stream)
+{
+    if (stream.size() < header_size || std::memcmp(stream.data(), magic, sizeof magic) != 0)
+        throw std::invalid_argument("not a striped JPEG-LS stream");
+    stripe_index index;
+    index.width = static_cast<uint32_t>(get(stream.data() + 8, 4));
+    index.height = static_cast<uint32_t>(get(stream.data() + 12, 4));
+    index.rows = static_cast<uint32_t>(get(stream.data() + 16, 4));
+    const uint64_t count = get(stream.data() + 20, 4);
+    if (index.rows == 0 || count == 0 || count != (static_cast<uint64_t>(index.height) + index.rows - 1) / index.rows)
+        throw std::invalid_argument("inconsistent stripe count");
+    const size_t index_size = 8 * (static_cast<size_t>(count) + 1);
+    if (stream.size() < header_size + index_size)
+        throw std::invalid_argument("truncated stripe index");
+    index.offsets.resize(static_cast<size_t>(count) + 1);
+    for (size_t k = 0; k < index.offsets.size(); ++k)
+    {
+        const uint64_t offset = get(stream.data() + header_size + 8 * k, 8);
+        const size_t previous = k ? index.offsets[k - 1] : header_size + index_size;
+        if (offset < previous || offset > stream.size())
+            throw std::invalid_argument("invalid stripe offset");
+        index.offsets[k] = offset;
+    }
+    return index;
+}
+
+// `planes` planes of `height` rows of `row_size` bytes
+void layout(image_info const& ii, size_t& planes, size_t& row_size)
+{
+    auto& frame_info = ii.frame_info();
+    const size_t pixel_size = static_cast<size_t>(frame_info.component_count) * ((frame_info.bits_per_sample + 7) / 8);
+    planes = ii.interleave_mode() == charls::interleave_mode::none ? frame_info.component_count : 1;
+    row_size = frame_info.width * pixel_size / planes;
+}
+
+// image info of the whole image, from the header of the first stripe
+void read_stripe_info(span<const uint8_t> stream, stripe_index const& index, image_info& ii)
+{
+    const auto encoded = index.stripe(stream, 0);
+    charls::jpegls_decoder decoder;
+    decoder.source(encoded);
+    std::string comment;
+#if CHARLS_VERSION_MAJOR > 2 || (CHARLS_VERSION_MAJOR == 2 && CHARLS_VERSION_MINOR > 2)
+    {
+        decoder.at_comment([&comment](const void* data, const size_t size) noexcept {
+            comment = std::string(static_cast<const char*>(data), size);
+        });
+    }
+#endif
+    decoder.read_header();
+    if (decoder.frame_info().width != index.width)
+        throw std::invalid_argument("inconsistent stripe width");
+    ii.frame_info() = decoder.frame_info();
+    ii.frame_info().height = index.height;
+    ii.interleave_mode() = decoder.interleave_mode();
+    ii.comment() = comment;
+}
+
+/**
+ * Decodes stripes [first, last) concurrently, `i` holds the image info read
+ * by read_stripe_info and receives the rows covered by these stripes.
+ */
+void decode_stripes(span<const uint8_t> stream, stripe_index const& index, size_t first, size_t last, image& i,
+                    int jobs)
+{
+    auto& frame_info = i.get_image_info().frame_info();
+    const size_t y0 = first * index.rows;
+    const size_t height = std::min(last * index.rows, static_cast<size_t>(index.height)) - y0;
+    frame_info.height = static_cast<uint32_t>(height);
+    size_t planes, row_size;
+    layout(i.get_image_info(), planes, row_size);
+    auto& pixel_data = i.get_image_data().pixel_data();
+    pixel_data.resize(planes * height * row_size);
+    const charls::frame_info expected = frame_info;
+    const auto interleave_mode = i.get_image_info().interleave_mode();
+
+    parallel::for_each(last - first, jobs, [&](size_t n, unsigned int) {
+        const size_t k = first + n;
+        const auto encoded = index.stripe(stream, k);
+        stats::scope scope(stats::decode, encoded.size());
+        charls::jpegls_decoder decoder;
+        decoder.source(encoded);
+        decoder.read_header();
+        auto& stripe_info = decoder.frame_info();
+        const size_t y = k * index.rows - y0;
+        const size_t rows = std::min(static_cast<size_t>(index.rows), index.height - k * index.rows);
+        if (stripe_info.width != expected.width || stripe_info.bits_per_sample != expected.bits_per_sample ||
+            stripe_info.component_count != expected.component_count || stripe_info.height != rows ||
+            decoder.interleave_mode() != interleave_mode)
+            throw std::invalid_argument("inconsistent stripe");
+        scope.bytes_out(planes * rows * row_size);
+        if (planes == 1)
+        {
+            // straight into the image:
+            decoder.decode(pixel_data.data() + y * row_size, rows * row_size);
+        }
+        else
+        {
+            // each plane of the stripe goes to a different plane of the image:
+            byte_buffer decoded(planes * rows * row_size);
+            decoder.decode(decoded);
+            for (size_t plane = 0; plane < planes; ++plane)
+                std::memcpy(pixel_data.data() + (plane * height + y) * row_size,
+                            decoded.data() + plane * rows * row_size, rows * row_size);
+        }
+    });
+}
+} // namespace
+
+bool jlss::handle_type(std::string const& type) const
+{
+    return type == "jlss";
+}
+
+void jlss::read_info(source& s, image& i) const
+{
+    s.rewind();
+    const auto stream = s.map();
+    read_stripe_info(stream, parse(stream), i.get_image_info());
+}
+
+void jlss::read_data(source& s, image& i) const
+{
+    s.rewind();
+    const auto stream = s.map();
+    const stripe_index index = parse(stream);
+    decode_stripes(stream, index, 0, index.count(), i, jobs_);
+}
+
+void jlss::write_info(dest&, const image&, const jls_options&) const
+{
+}
+
+void jlss::write_data(dest& d, const image& img, const jls_options& jo) const
+{
+    auto& frame_info = img.get_image_info().frame_info();
+    if (frame_info.height == 0)
+        throw std::invalid_argument("empty image");
+    const uint32_t requested = std::max(jo.stripes, 1u);
+    const uint32_t rows = (frame_info.height + requested - 1) / requested;
+    const size_t count = (frame_info.height + rows - 1) / rows;
+    size_t planes, row_size;
+    layout(img.get_image_info(), planes, row_size);
+    const auto& pixel_data = img.get_image_data().pixel_data();
+    const size_t stride = img.get_image_data().stride() ? img.get_image_data().stride() : row_size;
+    const size_t plane_size = row_size * frame_info.height;
+
+    std::vector<byte_buffer> stripes(count);
+    parallel::for_each(count, jo.jobs, [&](size_t k, unsigned int) {
+        const size_t y = k * rows;
+        const size_t height = std::min(static_cast<size_t>(rows), frame_info.height - y);
+        image_info stripe_info = img.get_image_info();
+        stripe_info.frame_info().height = static_cast<uint32_t>(height);
+        if (k != 0)
+            stripe_info.comment().clear();
+        if (planes == 1)
+        {
+            // interleaved rows are contiguous, encode them in place:
+            jls::encode(stripe_info, img.get_image_data().view().subspan(y * stride, height * stride),
+                        img.get_image_data().stride(), jo, stripes[k]);
+            return;
+        }
+        byte_buffer stripe_data(planes * height * row_size);
+        for (size_t plane = 0; plane < planes; ++plane)
+            std::memcpy(stripe_data.data() + plane * height * row_size,
+                        pixel_data.data() + plane * plane_size + y * row_size, height * row_size);
+        jls::encode(stripe_info, span<const uint8_t>(stripe_data.data(), stripe_data.size()),
+                    img.get_image_data().stride(), jo, stripes[k]);
+    });
+
+    std::vector<uint8_t> header(magic, magic + sizeof magic);
+    put(header, frame_info.width, 4);
+    put(header, frame_info.height, 4);
+    put(header, rows, 4);
+    put(header, count, 4);
+    uint64_t offset = header_size + 8 * (count + 1);
+    put(header, offset, 8);
+    for (auto& stripe : stripes)
+    {
+        offset += stripe.size();
+        put(header, offset, 8);
+    }
+    d.write(header.data(), header.size());
+    for (auto& stripe : stripes)
+        d.write(stripe.data(), stripe.size());
+}
+
+void jlss::transform(dest& d, source& s, const tran_options& to) const
+{
+    s.rewind();
+    const auto stream = s.map();
+    const stripe_index index = parse(stream);
+
+    // encoding parameters of the first stripe, shared by all stripes:
+    const auto encoded = index.stripe(stream, 0);
+    charls::jpegls_decoder decoder;
+    decoder.source(encoded);
+    decoder.read_header();
+    jls_options jo = jls::get_options(decoder);
+    jo.jobs = jobs_;
+
+    jlst::image input_image;
+    read_stripe_info(stream, index, input_image.get_image_info());
+    if (to.type == tran_options::transform_type::crop)
+    {
+        // only decode the stripes intersecting the region:
+        auto& region = to.region;
+        const size_t first = std::min(static_cast<size_t>(region.Y / index.rows), index.count() - 1);
+        const size_t end = (static_cast<size_t>(region.Y) + region.Height + index.rows - 1) / index.rows;
+        const size_t last = std::max(std::min(end, index.count()), first + 1);
+        decode_stripes(stream, index, first, last, input_image, jobs_);
+        input_image.crop(region.X, region.Y - static_cast<uint32_t>(first * index.rows), region.Width, region.Height,
+                         to.jobs);
+        // keep the stripe height of the input:
+        jo.stripes = (region.Height + index.rows - 1) / index.rows;
+        write_data(d, input_image, jo);
+    }
+    else
+    {
+        decode_stripes(stream, index, 0, index.count(), input_image, jobs_);
+        jo.stripes = static_cast<uint32_t>(index.count());
+        jls::apply(input_image, to);
+        write_data(d, input_image, jo);
+    }
+}
+
+format* jlss::clone() const
+{
+    return new jlss(jobs_);
+}
+
+static const format* get()
+{
+    static const jlss jlss_;
+    return &jlss_;
+}
+static bool b = factory::instance().register_format(get(), 1);
+static bool s = factory::instance().register_signature(get(), std::string(magic, sizeof magic));
+} // namespace jlst
@@ -0,0 +1,37 @@
+// Copyright (c) Mathieu Malaterre
+// SPDX-License-Identifier: BSD-3-Clause
+#pragma once
+#include "format.h"
+
+namespace jlst {
+class tran_options;
+/**
+ * Striped JPEG-LS: the image is split into horizontal stripes, each one
+ * stored as an independent JPEG-LS codestream, preceded by an offset index
+ * (see jlss.cpp for the layout). Stripes are encoded and decoded
+ * concurrently, and a region can be decoded from the intersecting stripes
+ * only.
+ */
+class jlss : public format
+{
+public:
+    // `jobs` threads decode the stripes, 0 for one per core
+    explicit jlss(int jobs = 1) : jobs_(jobs)
+    {
+    }
+    format* clone() const override;
+    bool handle_type(std::string const& type) const override;
+
+    void read_info(source& s, image& i) const override;
+    void read_data(source& s, image& i) const override;
+
+    void write_info(dest& d, const image& i, const jls_options& jo) const override;
+    void write_data(dest& d, const image& i, const jls_options& jo) const override;
+
+    // same as jls::transform, crop only decodes the stripes intersecting the region
+    void transform(dest& d, source& s, const tran_options& to) const;
+
+private:
+    int jobs_;
+};
+} // namespace jlst
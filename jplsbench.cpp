@@ -0,0 +1,294 @@
+// Copyright (c) Mathieu Malaterre
+// SPDX-License-Identifier: BSD-3-Clause
+#include "cjpls_options.h"       // for jls_options
+#include "dest.h"                // for dest
+#include "factory.h"             // for factory
+#include "format.h"              // for format
+#include "image.h"               // for image
+#include "jls.h"                 // for jls
+#include "jplsbench_options.h"   // for bench_options
+#include "source.h"              // for source
+#include <charls/charls.h>       // for jpegls_decoder
+#include <algorithm>             // for sort, min
+#include <chrono>                // for steady_clock
+#include <cmath>                 // for ceil
+#include <cstdlib>               // for EXIT_FAILURE, EXIT_SUCCESS
+#include <cstring>               // for memcpy
+#include <iomanip>               // for setprecision
+#include <iostream>              // for operator<<, endl, basic_ostream, cerr
+#include <memory>                // for unique_ptr
+#include <sstream>               // for ostringstream
+#include <string>                // for string
+#include <vector>                // for vector
+
+namespace {
+// option values indexed by enum value
+const char* const interleave_modes[] = {"none", "line", "sample"};
+const char* const color_transformations[] = {"none", "hp1", "hp2", "hp3"};
+
+/**
+ * Smooth gradients, correlated across components, plus some noise: the
+ * predictor and the context modeling have work to do, and the color
+ * transformations something to decorrelate. The content only depends on the
+ * arguments, so that runs can be compared.
+ */
+jlst::image synthetic_image(uint32_t width, uint32_t height, int bits_per_sample, int component_count)
+{
+    jlst::image ret;
+    auto& frame_info = ret.get_image_info().frame_info();
+    frame_info.width = width;
+    frame_info.height = height;
+    frame_info.bits_per_sample = bits_per_sample;
+    frame_info.component_count = component_count;
+    ret.get_image_info().interleave_mode() =
+        component_count == 1 ? charls::interleave_mode::none : charls::interleave_mode::sample;
+    const uint64_t maximum = (1u << bits_per_sample) - 1;
+    const size_t bytes_per_sample = bits_per_sample > 8 ? 2 : 1;
+    auto& pixel_data = ret.get_image_data().pixel_data();
+    pixel_data.resize(static_cast<size_t>(width) * height * static_cast<size_t>(component_count) * bytes_per_sample);
+    uint8_t* out = pixel_data.data();
+    uint32_t state = 2463534242u; // xorshift32
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            for (int c = 0; c < component_count; ++c)
+            {
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                const uint64_t wx = static_cast<uint64_t>(c) + 1;
+                const uint64_t wy = static_cast<uint64_t>(c) + 2;
+                const uint64_t base = (x * wx + y * wy) * maximum / (width * wx + height * wy);
+                const uint64_t value = std::min(base + state % (maximum / 32 + 1), maximum);
+                if (bytes_per_sample == 1)
+                {
+                    *out = static_cast<uint8_t>(value);
+                }
+                else
+                {
+                    const uint16_t sample = static_cast<uint16_t>(value);
+                    std::memcpy(out, &sample, sizeof sample);
+                }
+                out += bytes_per_sample;
+            }
+        }
+    }
+    return ret;
+}
+
+// the combinations compress() and charls accept
+bool is_legal(charls::frame_info const& frame_info, jlst::jls_options const& jo)
+{
+    if (frame_info.component_count == 1 && jo.interleave_mode != charls::interleave_mode::none)
+        return false;
+    if (jo.color_transformation != charls::color_transformation::none &&
+        (frame_info.component_count != 3 || (frame_info.bits_per_sample != 8 && frame_info.bits_per_sample != 16) ||
+         jo.interleave_mode == charls::interleave_mode::none))
+        return false;
+    const int maximum = (1 << frame_info.bits_per_sample) - 1;
+    return jo.near_lossless >= 0 && jo.near_lossless <= std::min(255, maximum / 2);
+}
+
+// throughput and latency of `seconds.size()` runs over `bytes` bytes of `pixels` pixels
+void print_timings(std::ostream& os, std::vector<double>& seconds, size_t bytes, size_t pixels)
+{
+    double total = 1e-9; // never 0, even with a coarse clock
+    for (double s : seconds)
+        total += s;
+    std::sort(seconds.begin(), seconds.end());
+    // nearest rank percentiles:
+    auto percentile = [&seconds](double p) {
+        const size_t rank = static_cast<size_t>(std::ceil(p * static_cast<double>(seconds.size())));
+        return seconds[std::max(rank, static_cast<size_t>(1)) - 1];
+    };
+    const double runs = static_cast<double>(seconds.size());
+    os << std::fixed << "{\"mb_per_s\":" << std::setprecision(1) << static_cast<double>(bytes) * runs / total / 1e6
+       << ",\"pixels_per_s\":" << std::setprecision(0) << static_cast<double>(pixels) * runs / total
+       << ",\"p50_ms\":" << std::setprecision(3) << percentile(0.5) * 1e3 << ",\"p99_ms\":" << percentile(0.99) * 1e3
+       << '}';
+}
+
+/**
+ * Encodes then decodes `img` in memory, `iterations` timed times each after
+ * an untimed warm-up run, and prints the JSON record of the configuration.
+ */
+void bench(std::ostream& os, std::string const& name, jlst::image const& img, jlst::jls_options const& jo,
+           int iterations)
+{
+    typedef std::chrono::steady_clock clock;
+    auto& frame_info = img.get_image_info().frame_info();
+    const size_t pixels = static_cast<size_t>(frame_info.width) * frame_info.height;
+    const size_t raw_size = pixels * static_cast<size_t>(frame_info.component_count) *
+                            static_cast<size_t>((frame_info.bits_per_sample + 7) / 8);
+
+    jlst::byte_buffer encoded;
+    jlst::jls::encode(img, jo, encoded);
+    std::vector<double> encode_seconds;
+    for (int i = 0; i < iterations; ++i)
+    {
+        const auto start = clock::now();
+        jlst::jls::encode(img, jo, encoded);
+        encode_seconds.push_back(std::chrono::duration<double>(clock::now() - start).count());
+    }
+
+    jlst::byte_buffer decoded;
+    {
+        charls::jpegls_decoder decoder;
+        decoder.source(encoded);
+        decoder.read_header();
+        decoded.resize(decoder.destination_size());
+        decoder.decode(decoded);
+    }
+    std::vector<double> decode_seconds;
+    for (int i = 0; i < iterations; ++i)
+    {
+        const auto start = clock::now();
+        charls::jpegls_decoder decoder;
+        decoder.source(encoded);
+        decoder.read_header();
+        decoder.decode(decoded);
+        decode_seconds.push_back(std::chrono::duration<double>(clock::now() - start).count());
+    }
+
+    os << "{\"image\":\"" << jlst::options::escape_json(name) << "\",\"width\":" << frame_info.width
+       << ",\"height\":" << frame_info.height << ",\"bits_per_sample\":" << frame_info.bits_per_sample
+       << ",\"component_count\":" << frame_info.component_count << ",\"interleave_mode\":\""
+       << interleave_modes[static_cast<int>(jo.interleave_mode)] << "\",\"near_lossless\":" << jo.near_lossless
+       << ",\"color_transformation\":\"" << color_transformations[static_cast<int>(jo.color_transformation)]
+       << "\",\"raw_size\":" << raw_size << ",\"encoded_size\":" << encoded.size() << ",\"compression_ratio\":"
+       << std::fixed << std::setprecision(3) << static_cast<double>(raw_size) / static_cast<double>(encoded.size())
+       << ",\"encode\":";
+    print_timings(os, encode_seconds, raw_size, pixels);
+    os << ",\"decode\":";
+    print_timings(os, decode_seconds, raw_size, pixels);
+    os << '}';
+}
+
+// every legal configuration of the command line for `img`, records separated by ",\n"
+void bench_all(std::ostream& os, bool& first, std::string const& name, jlst::image const& img,
+               jlst::bench_options const& options)
+{
+    for (auto interleave_mode : options.interleave_modes)
+    {
+        for (int near_lossless : options.near_lossless)
+        {
+            for (auto color_transformation : options.color_transformations)
+            {
+                jlst::jls_options jo{};
+                jo.has_interleave_mode = true;
+                jo.interleave_mode = interleave_mode;
+                jo.near_lossless = near_lossless;
+                jo.has_color_transformation = color_transformation != charls::color_transformation::none;
+                jo.color_transformation = color_transformation;
+                if (!is_legal(img.get_image_info().frame_info(), jo))
+                    continue;
+                std::ostringstream record;
+                bench(record, name, img, jo, options.iterations);
+                os << (first ? "" : ",\n") << "    " << record.str();
+                first = false;
+            }
+        }
+    }
+}
+
+// format detected from the signature, or else from the file extension
+std::unique_ptr<jlst::format> get_format(jlst::source& source)
+{
+    jlst::format* ptr = jlst::factory::instance().detect_format(source);
+    if (!ptr)
+        ptr = jlst::factory::instance().get_format_from_type(
+            jlst::options::compute_type_from_filename(source.get_filename()));
+    if (ptr)
+        return std::unique_ptr<jlst::format>(ptr);
+    throw std::invalid_argument("no format");
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    jlst::bench_options options{};
+    try
+    {
+        if (!options.process(argc, argv))
+        {
+            // help, or version requested. Return without error
+            return EXIT_SUCCESS;
+        }
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << "Invalid options: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    catch (...)
+    {
+        std::cerr << "unknown exception during options parsing" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    bool success = true;
+    try
+    {
+        std::ostringstream os;
+        bool first = true;
+        os << "{\n  \"charls_version\": \"" << charls_get_version_string() << "\",\n  \"iterations\": "
+           << options.iterations << ",\n  \"results\": [\n";
+        auto& sources = options.get_sources();
+        std::vector<std::string> paths;
+        for (auto& directory : options.directories)
+            jlst::options::walk(directory, paths);
+        if (sources.empty() && paths.empty())
+        {
+            for (int bits_per_sample : options.bits_per_sample)
+                for (int component_count : options.component_count)
+                    bench_all(os, first, "synthetic",
+                              synthetic_image(options.width, options.height, bits_per_sample, component_count),
+                              options);
+        }
+        for (auto& source : sources)
+        {
+            try
+            {
+                auto format = get_format(source);
+                bench_all(os, first, source.get_filename(), format->load(source, jlst::image_info{}), options);
+            }
+            catch (std::exception& e)
+            {
+                std::cerr << source.get_filename() << ": " << e.what() << std::endl;
+                success = false;
+            }
+        }
+        // corpus directories: files of an unknown format are skipped
+        for (auto& path : paths)
+        {
+            try
+            {
+                jlst::source source(path);
+                std::unique_ptr<jlst::format> format(jlst::factory::instance().detect_format(source));
+                if (format)
+                    bench_all(os, first, path, format->load(source, jlst::image_info{}), options);
+            }
+            catch (std::exception& e)
+            {
+                std::cerr << path << ": " << e.what() << std::endl;
+                success = false;
+            }
+        }
+        os << "\n  ]\n}\n";
+        const std::string str = os.str();
+        options.get_dest(0).write(str.data(), str.size());
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << "Error during benchmark: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    catch (...)
+    {
+        std::cerr << "unknown exception during benchmark" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
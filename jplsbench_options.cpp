@@ -0,0 +1,188 @@
+// Copyright (c) Mathieu Malaterre
+// SPDX-License-Identifier: BSD-3-Clause
+#include "jplsbench_options.h"
+
+#include "tuple.h"
+#include "version.h"
+
+#include <boost/program_options.hpp>
+#include <cstring>
+#include <iostream>
+
+namespace jlst {
+
+static charls::interleave_mode string_to_interleave_mode(const char* argument)
+{
+    if (strcmp(argument, "none") == 0)
+        return charls::interleave_mode::none;
+
+    if (strcmp(argument, "line") == 0)
+        return charls::interleave_mode::line;
+
+    if (strcmp(argument, "sample") == 0)
+        return charls::interleave_mode::sample;
+
+    throw std::runtime_error("Argument interleave-mode needs to be: none, line or sample\n");
+}
+
+static charls::color_transformation string_to_color_transformation(const char* argument)
+{
+    if (strcmp(argument, "none") == 0)
+        return charls::color_transformation::none;
+
+    if (strcmp(argument, "hp1") == 0)
+        return charls::color_transformation::hp1;
+
+    if (strcmp(argument, "hp2") == 0)
+        return charls::color_transformation::hp2;
+
+    if (strcmp(argument, "hp3") == 0)
+        return charls::color_transformation::hp3;
+
+    throw std::runtime_error("Argument color_transformation needs to be: none, hp1, hp2 or hp3\n");
+}
+
+bool bench_options::process(int argc, char* argv[])
+{
+    std::vector<std::string> inputs{};
+    std::vector<std::string> outputs{};
+    std::vector<std::string> interleave_mode_strs{};
+    std::vector<std::string> color_transformation_strs{};
+    typedef tuple<int, 2> size_type; // width + height
+    size_type size{};
+    {
+        namespace po = boost::program_options;
+        po::options_description generic("Generic options");
+        generic.add_options()                                                                  //
+            ("input,i", po::value(&inputs), "Corpus image (JPEG-LS, pnm...).")                 // input
+            ("recursive,r", po::value(&directories), "Corpus directory, walked recursively.") // corpus
+            ("output,o", po::value(&outputs), "Output filename (JSON report).")                // output
+            ("iterations,N", po::value(&iterations),
+             "Timed encodes and decodes per configuration (default 10).") // iterations
+            ;
+
+        po::options_description synthetic("Synthetic images (when there is no corpus)");
+        synthetic.add_options() //
+            ("size,s", po::value(&size), "Size of images (width, height), default 512x512.") // size
+            ("bits_per_sample,b", po::value(&bits_per_sample)->multitoken(),
+             "Bits per sample values (default 8 12 16).") // bits per sample
+            ("component_count,c", po::value(&component_count)->multitoken(),
+             "Component count values (default 1 3).") // component count
+            ;
+
+        po::options_description jpegls("Encoding configurations (every combination is measured)");
+        jpegls.add_options() //
+            ("interleave_mode,m", po::value(&interleave_mode_strs)->multitoken(),
+             "Interleave modes: `none|line|sample` (default all).") // interleave mode
+            ("near_lossless,n", po::value(&near_lossless)->multitoken(),
+             "Near lossless values (default 0).") // near lossless
+            ("color_transformation,t", po::value(&color_transformation_strs)->multitoken(),
+             "Color transformations: `none|hp1|hp2|hp3` (default none).") // color transformation
+            ;
+
+        po::options_description desc("Allowed options");
+        desc.add_options()("help,h", "print usage message") // help
+            ("version", "print version")                    // version
+            ;
+        desc.add(generic);
+        desc.add(synthetic);
+        desc.add(jpegls);
+
+        po::variables_map vm;
+        po::store(po::command_line_parser(argc, argv).options(desc).run(), vm);
+
+        if (vm.count("help"))
+        {
+            std::cout << "usage: jplsbench [options] [-i input] [-r directory]\n";
+            std::cout << desc << std::endl;
+            return false;
+        }
+
+        if (vm.count("version"))
+        {
+            std::cout << "jplsbench version: " << JLST_VERSION << "\n";
+            std::cout << "charls version: " << charls_get_version_string() << std::endl;
+            return false;
+        }
+
+        try
+        {
+            po::notify(vm);
+
+            if (vm.count("input"))
+            {
+                add_inputs(inputs);
+            }
+
+            if (vm.count("output"))
+            {
+                add_outputs(outputs);
+            }
+            else
+            {
+                add_stdout_output(false);
+            }
+        }
+        catch (std::exception&)
+        {
+            // default value missing. Let's print usage before re-throw:
+            std::cout << "usage: jplsbench [options] [-i input] [-r directory]\n";
+            std::cout << desc << std::endl;
+            throw;
+        }
+
+        if (iterations < 1)
+        {
+            throw std::invalid_argument("iterations: " + std::to_string(iterations));
+        }
+        if (vm.count("size"))
+        {
+            const int* val = size.values;
+            if (val[0] <= 0 || val[1] <= 0)
+                throw std::invalid_argument("size: empty image");
+            width = val[0];
+            height = val[1];
+        }
+        if (bits_per_sample.empty())
+        {
+            bits_per_sample = {8, 12, 16};
+        }
+        for (int bits : bits_per_sample)
+        {
+            if (bits < 2 || bits > 16)
+                throw std::invalid_argument("bits_per_sample: " + std::to_string(bits));
+        }
+        if (component_count.empty())
+        {
+            component_count = {1, 3};
+        }
+        for (int count : component_count)
+        {
+            if (count < 1 || count > 255)
+                throw std::invalid_argument("component_count: " + std::to_string(count));
+        }
+        for (auto& str : interleave_mode_strs)
+        {
+            interleave_modes.push_back(string_to_interleave_mode(str.c_str()));
+        }
+        if (interleave_modes.empty())
+        {
+            interleave_modes = {charls::interleave_mode::none, charls::interleave_mode::line,
+                                charls::interleave_mode::sample};
+        }
+        if (near_lossless.empty())
+        {
+            near_lossless = {0};
+        }
+        for (auto& str : color_transformation_strs)
+        {
+            color_transformations.push_back(string_to_color_transformation(str.c_str()));
+        }
+        if (color_transformations.empty())
+        {
+            color_transformations = {charls::color_transformation::none};
+        }
+    }
+    return true;
+}
+} // namespace jlst
@@ -0,0 +1,36 @@
+// Copyright (c) Mathieu Malaterre
+// SPDX-License-Identifier: BSD-3-Clause
+#pragma once
+
+#include "options.h"
+
+#include <charls/charls.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace jlst {
+struct bench_options final : options
+{
+    // corpus: inputs (`-i`, see get_sources) and directories walked recursively
+    std::vector<std::string> directories{};
+    // synthetic images, used when there is no corpus
+    uint32_t width{512};
+    uint32_t height{512};
+    std::vector<int> bits_per_sample{};
+    std::vector<int> component_count{};
+    // encoding configurations, every combination is measured
+    std::vector<charls::interleave_mode> interleave_modes{};
+    std::vector<int> near_lossless{};
+    std::vector<charls::color_transformation> color_transformations{};
+    // timed encodes and decodes per configuration
+    int iterations{10};
+
+    /**
+     * Returns false when the process should stop, ie `help` or `version` was passed.
+     * Returns true when the next step encode/decode should continue.
+     */
+    bool process(int argc, char* argv[]);
+};
+} // namespace jlst
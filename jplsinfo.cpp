@@ -1,10 +1,20 @@
 // Copyright (c) Mathieu Malaterre
 // SPDX-License-Identifier: BSD-3-Clause
 #include "crc32.h"
+#include "factory.h"
+#include "format.h"
+#include "hash_index.h"
+#include "jls.h"
 #include "jplsinfo_options.h"
+#include "parallel.h"
+#include "stats.h"
+#include "xxhash.h"
 #include <charls/charls.h>
-#include <iomanip>
+
+#include <algorithm>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <sstream>
 #include <vector>
 
@@ -21,7 +31,7 @@ struct writer
     virtual void print_value_separator(std::ostream& os, bool eol) = 0;
     template<typename T>
     void print_value(std::ostream& os, std::string const& key, const T& val);
-    virtual void print_string(std::ostream& os, std::string const& key, std::string const& val, bool is_integral) = 0;
+    virtual void print_string(std::ostream& os, std::string const& key, std::string const& val, bool is_number) = 0;
     bool pretty()
     {
         return pretty_;
@@ -103,51 +113,6 @@ struct yaml_writer : writer
 private:
 };
 
-namespace {
-// FIXME assume input is UTF-8:
-static std::string escape_json(const std::string& s)
-{
-    std::ostringstream o;
-    for (auto c = s.cbegin(); c != s.cend(); c++)
-    {
-        switch (*c)
-        {
-        case '"':
-            o << "\\\"";
-            break;
-        case '\\':
-            o << "\\\\";
-            break;
-        case '\b':
-            o << "\\b";
-            break;
-        case '\f':
-            o << "\\f";
-            break;
-        case '\n':
-            o << "\\n";
-            break;
-        case '\r':
-            o << "\\r";
-            break;
-        case '\t':
-            o << "\\t";
-            break;
-        default:
-            if ('\x00' <= *c && *c <= '\x1f')
-            {
-                o << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(*c);
-            }
-            else
-            {
-                o << *c;
-            }
-        }
-    }
-    return o.str();
-}
-} // namespace
-
 struct json_writer : writer
 {
     json_writer(bool pretty) : writer(pretty)
@@ -186,7 +151,7 @@ struct json_writer : writer
         if (pretty())
             os << '\n';
     }
-    void print_string(std::ostream& os, std::string const& key, std::string const& val, bool is_integral) override
+    void print_string(std::ostream& os, std::string const& key, std::string const& val, bool is_number) override
     {
         os << '"' << key << '"';
         if (pretty())
@@ -194,10 +159,10 @@ struct json_writer : writer
         os << ':';
         if (pretty())
             os << ' ';
-        if (!is_integral)
+        if (!is_number)
             os << '"';
-        os << escape_json(val);
-        if (!is_integral)
+        os << jlst::options::escape_json(val);
+        if (!is_number)
             os << '"';
     }
 
@@ -379,9 +344,9 @@ inline void writer::print_value(std::ostream& os, std::string const& key, const
 {
     std::stringstream ss;
     ss << val;
-    const bool is_integral = std::is_integral<T>::value;
+    const bool is_number = std::is_arithmetic<T>::value;
     print_tab(os);
-    print_string(os, key, ss.str(), is_integral);
+    print_string(os, key, ss.str(), is_number);
 }
 
 #define PRINT(S, K) \
@@ -433,16 +398,189 @@ static void print_frame_info(writer& writer, std::ostream& os, charls::jpegls_de
     PRINTONLY(frame_info, component_count);
     writer.print_footer(os, header);
 }
-static void print_hash(writer& writer, std::ostream& os, charls::jpegls_decoder const& decoder)
+static std::string index_filename(std::string const& filename)
+{
+    if (filename.empty())
+        throw std::invalid_argument("hash index requires a named input");
+    return filename + ".hidx";
+}
+
+static void print_bands(writer& writer, std::ostream& os, jlst::hash_index const& index)
+{
+    const char header[] = "bands";
+    writer.print_header(os, header);
+    for (size_t band = 0; band < index.digests.size(); ++band)
+    {
+        writer.print_value(os, "band" + std::to_string(band), index.to_string(band));
+        writer.print_value_separator(os, band + 1 == index.digests.size());
+    }
+    writer.print_footer(os, header);
+}
+
+// only the bands whose digest differ are listed, as a range of rows
+static size_t print_verify(writer& writer, std::ostream& os, jlst::hash_index const& expected,
+                           jlst::hash_index const& actual)
+{
+    std::vector<size_t> mismatches;
+    for (size_t band = 0; band < expected.digests.size(); ++band)
+    {
+        if (expected.digests[band] != actual.digests[band])
+            mismatches.push_back(band);
+    }
+    const char header[] = "verify";
+    writer.print_header(os, header);
+    writer.print_value(os, "band_height", expected.band_height);
+    writer.print_value_separator(os, false);
+    writer.print_value(os, "mismatches", mismatches.size());
+    for (auto band : mismatches)
+    {
+        const uint32_t first = static_cast<uint32_t>(band) * expected.band_height;
+        const uint32_t last = std::min(first + expected.band_height, expected.height) - 1;
+        writer.print_value_separator(os, false);
+        writer.print_value(os, "band" + std::to_string(band), std::to_string(first) + "-" + std::to_string(last));
+    }
+    writer.print_value_separator(os, true);
+    writer.print_footer(os, header);
+    return mismatches.size();
+}
+
+namespace {
+// compressed size of an input against the size of its decoded pixel data
+struct compression
+{
+    bool valid;
+    uint64_t compressed_size;
+    uint64_t uncompressed_size;
+    uint64_t pixels;
+    // image kind, for the summary:
+    int32_t component_count;
+    int32_t bits_per_sample;
+    int32_t near_lossless;
+
+    double bits_per_pixel() const
+    {
+        return pixels ? 8. * static_cast<double>(compressed_size) / static_cast<double>(pixels) : 0.;
+    }
+    double ratio() const
+    {
+        return compressed_size ? static_cast<double>(uncompressed_size) / static_cast<double>(compressed_size) : 0.;
+    }
+};
+} // namespace
+
+// header values and file size only, the uncompressed size is the size of the decoded buffer
+static compression get_compression(charls::jpegls_decoder const& decoder, uint64_t compressed_size)
+{
+    const charls::frame_info& frame_info = decoder.frame_info();
+    compression c{};
+    c.valid = true;
+    c.compressed_size = compressed_size;
+    c.pixels = static_cast<uint64_t>(frame_info.width) * frame_info.height;
+    c.uncompressed_size = c.pixels * static_cast<uint64_t>(frame_info.component_count) *
+                          static_cast<uint64_t>((frame_info.bits_per_sample + 7) / 8);
+    c.component_count = frame_info.component_count;
+    c.bits_per_sample = frame_info.bits_per_sample;
+    c.near_lossless = decoder.near_lossless();
+    return c;
+}
+
+/**
+ * The size of each scan (one per component) is only reported for interleave
+ * mode none, the whole stream is then read but never decoded.
+ */
+static void print_compression(writer& writer, std::ostream& os, charls::jpegls_decoder const& decoder,
+                              jlst::source& source, compression const& c)
+{
+    const char header[] = "compression";
+    writer.print_header(os, header);
+    writer.print_value(os, "compressed_size", c.compressed_size);
+    writer.print_value_separator(os, false);
+    writer.print_value(os, "uncompressed_size", c.uncompressed_size);
+    writer.print_value_separator(os, false);
+    writer.print_value(os, "bits_per_pixel", c.bits_per_pixel());
+    writer.print_value_separator(os, false);
+    writer.print_value(os, "ratio", c.ratio());
+    if (decoder.interleave_mode() == charls::interleave_mode::none)
+    {
+        std::vector<size_t> sizes;
+        {
+            jlst::stats::scope scope(jlst::stats::header);
+            const auto stream = source.map();
+            scope.bytes_in(stream.size());
+            sizes = jlst::jls::scan_sizes(stream);
+        }
+        writer.print_value_separator(os, false);
+        const char scans[] = "scans";
+        writer.print_header(os, scans);
+        for (size_t scan = 0; scan < sizes.size(); ++scan)
+        {
+            writer.print_value(os, "scan" + std::to_string(scan), sizes[scan]);
+            writer.print_value_separator(os, scan + 1 == sizes.size());
+        }
+        writer.print_footer(os, scans);
+    }
+    writer.print_value_separator(os, true);
+    writer.print_footer(os, header);
+}
+
+/**
+ * Returns false when `--verify-index` found differing bands.
+ */
+static bool print_hash(writer& writer, std::ostream& os, charls::jpegls_decoder const& decoder,
+                       jlst::info_options const& options, std::string const& filename)
 {
-    std::vector<uint8_t> decoded_buffer(decoder.destination_size());
-    decoder.decode(decoded_buffer);
-    std::string crc32 = jlst::crc32::compute(decoded_buffer);
+    jlst::byte_buffer decoded_buffer(decoder.destination_size());
+    {
+        jlst::stats::scope scope(jlst::stats::decode, 0, decoded_buffer.size());
+        decoder.decode(decoded_buffer);
+    }
+    jlst::stats::scope scope(jlst::stats::hash, decoded_buffer.size());
+    const int jobs = options.hash_jobs;
+    const std::string digest = options.hash == "xxh64" ? jlst::xxh64::compute(decoded_buffer)
+                                                       : jlst::crc32::compute(decoded_buffer, jobs);
     const char header[] = "hash";
     writer.print_header(os, header);
-    writer.print_value(os, "crc32", crc32);
+    writer.print_value(os, options.hash, digest);
+
+    size_t mismatches = 0;
+    if (options.band_height || options.verify_index)
+    {
+        // decoded buffer is one plane per component for interleave mode none:
+        const charls::frame_info& frame_info = decoder.frame_info();
+        const bool planar = decoder.interleave_mode() == charls::interleave_mode::none;
+        const int planes = planar ? frame_info.component_count : 1;
+        const size_t row_size = static_cast<size_t>(frame_info.width) * (frame_info.bits_per_sample <= 8 ? 1 : 2) *
+                                static_cast<size_t>(planar ? 1 : frame_info.component_count);
+        writer.print_value_separator(os, false);
+        if (options.verify_index)
+        {
+            jlst::source sidecar(index_filename(filename));
+            const jlst::hash_index expected = jlst::hash_index::load(sidecar);
+            if (expected.width != frame_info.width || expected.height != frame_info.height)
+                throw std::invalid_argument("hash index: dimensions mismatch");
+            const jlst::hash_index actual =
+                jlst::hash_index::compute(expected.hash, decoded_buffer, frame_info.width, frame_info.height, row_size,
+                                          planes, expected.band_height, jobs);
+            mismatches = print_verify(writer, os, expected, actual);
+        }
+        else
+        {
+            const jlst::hash_index index =
+                jlst::hash_index::compute(options.hash, decoded_buffer, frame_info.width, frame_info.height, row_size,
+                                          planes, options.band_height, jobs);
+            writer.print_value(os, "band_height", options.band_height);
+            writer.print_value_separator(os, false);
+            print_bands(writer, os, index);
+            if (options.write_index)
+            {
+                jlst::dest sidecar(index_filename(filename));
+                index.save(sidecar);
+            }
+        }
+    }
     writer.print_value_separator(os, true);
     writer.print_footer(os, header);
+    return mismatches == 0;
 }
 
 #undef PRINT
@@ -472,11 +610,70 @@ static void print_header(writer& writer, std::ostream& os, charls::jpegls_decode
 }
 #undef PRINTFUN
 
-static bool dump(writer& writer, jlst::source& source, jlst::dest& dest, bool with_hash)
+static long long predicate_value(std::string const& key, charls::jpegls_decoder const& decoder)
+{
+    const charls::frame_info& frame_info = decoder.frame_info();
+    if (key == "width")
+        return frame_info.width;
+    if (key == "height")
+        return frame_info.height;
+    if (key == "bits_per_sample")
+        return frame_info.bits_per_sample;
+    if (key == "component_count")
+        return frame_info.component_count;
+    if (key == "near_lossless")
+        return decoder.near_lossless();
+    throw std::invalid_argument("where: " + key);
+}
+
+template<typename T>
+static bool compare(std::string const& op, const T& lhs, const T& rhs)
+{
+    if (op == "=")
+        return lhs == rhs;
+    if (op == "!=")
+        return !(lhs == rhs);
+    if (op == "<")
+        return lhs < rhs;
+    if (op == "<=")
+        return !(rhs < lhs);
+    if (op == ">")
+        return rhs < lhs;
+    if (op == ">=")
+        return !(lhs < rhs);
+    throw std::invalid_argument("where: " + op);
+}
+
+// only header values are used, the image is never decoded here
+static bool match(std::vector<jlst::info_options::predicate> const& predicates, charls::jpegls_decoder const& decoder)
+{
+    for (auto& p : predicates)
+    {
+        bool ok;
+        if (p.key == "interleave_mode")
+            ok = compare<std::string>(p.op, interleave_mode_to_string(decoder.interleave_mode()), p.value);
+        else if (p.key == "color_transformation")
+            ok = compare<std::string>(p.op, color_transformation_to_string(decoder.color_transformation()), p.value);
+        else
+            ok = compare(p.op, predicate_value(p.key, decoder), std::stoll(p.value));
+        if (!ok)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Returns false on error. `out` and `c` are left untouched when the input does
+ * not match the `--where` predicates.
+ */
+static bool dump(writer& writer, jlst::source& source, std::string& out, std::ostream& err,
+                 jlst::info_options const& options, compression& c)
 {
     try
     {
-        const std::vector<uint8_t> encoded_source = source.read_bytes();
+        // zero-copy view of the input stream, must outlive the decoder. Without
+        // hash the pixel data is never decoded, only the header bytes are read:
+        const auto encoded_source = options.with_hash ? source.map() : jlst::jls::read_header_bytes(source);
 
         charls::jpegls_decoder decoder;
         decoder.source(encoded_source);
@@ -490,17 +687,30 @@ static bool dump(writer& writer, jlst::source& source, jlst::dest& dest, bool wi
         }
 #endif
 
+        bool success = true;
         // start decoding to check any exception:
-        decoder.read_spiff_header();
+        {
+            jlst::stats::scope scope(jlst::stats::header);
+            decoder.read_spiff_header();
+            decoder.read_header();
+        }
+        if (!match(options.predicates, decoder))
+            return true;
 
         std::ostringstream os;
         writer.print_header(os, "");
+        if (options.format == "ndjson")
+        {
+            writer.print_value(os, "path", source.get_filename());
+            writer.print_value_separator(os, false);
+            writer.print_value(os, "size", source.size());
+            writer.print_value_separator(os, false);
+        }
         if (decoder.spiff_header_has_value())
         {
             print_spiff_header(writer, os, decoder.spiff_header());
             writer.print_value_separator(os, false);
         }
-        decoder.read_header();
         print_header(writer, os, decoder);
 
         // comment:
@@ -510,24 +720,187 @@ static bool dump(writer& writer, jlst::source& source, jlst::dest& dest, bool wi
             writer.print_value(os, "comment", comment);
         }
 
-        if (with_hash)
+        if (options.with_compression || options.summary)
+        {
+            c = get_compression(decoder, source.size());
+        }
+        if (options.with_compression)
+        {
+            writer.print_value_separator(os, false);
+            print_compression(writer, os, decoder, source, c);
+        }
+
+        if (options.with_hash)
         {
             writer.print_value_separator(os, false);
-            print_hash(writer, os, decoder);
+            if (!print_hash(writer, os, decoder, options, source.get_filename()))
+            {
+                err << source.get_filename() << ": bands differ from hash index" << std::endl;
+                success = false;
+            }
         }
         writer.print_value_separator(os, true);
 
         writer.print_footer(os, "");
         os << std::endl;
-        std::string s = os.str();
-        dest.write(s.c_str(), s.size());
+        out += os.str();
+        return success;
     }
     catch (std::exception& e)
     {
-        std::cerr << "Failure during dump: " << e.what() << std::endl;
+        err << "Failure during dump: " << e.what() << std::endl;
         return false;
     }
-    return true;
+}
+
+namespace {
+// output of a single input, emitted in input order:
+struct record
+{
+    std::string out;
+    std::string err;
+    bool success;
+    compression c;
+};
+
+// `--summary`: compression of all the inputs, aggregated in input order
+struct summary
+{
+    struct totals
+    {
+        uint64_t files;
+        uint64_t compressed_size;
+        uint64_t uncompressed_size;
+        uint64_t pixels;
+        double ratios; // sum, for the mean ratio
+    };
+    // lower bounds of the ratio histogram buckets, the first one is [0, 1)
+    static constexpr double bounds[] = {0., 1., 1.5, 2., 3., 4., 6., 8.};
+    static constexpr size_t bucket_count = sizeof(bounds) / sizeof(bounds[0]);
+
+    totals all{};
+    uint64_t histogram[bucket_count]{};
+    // per image kind: `c<component_count>_b<bits_per_sample>_n<near_lossless>`
+    std::map<std::string, totals> kinds{};
+
+    void add(compression const& c)
+    {
+        if (!c.valid)
+            return;
+        const double ratio = c.ratio();
+        add(all, c, ratio);
+        add(kinds["c" + std::to_string(c.component_count) + "_b" + std::to_string(c.bits_per_sample) + "_n" +
+                  std::to_string(c.near_lossless)],
+            c, ratio);
+        size_t bucket = bucket_count - 1;
+        while (bucket > 0 && ratio < bounds[bucket])
+            --bucket;
+        ++histogram[bucket];
+    }
+
+private:
+    static void add(totals& t, compression const& c, double ratio)
+    {
+        ++t.files;
+        t.compressed_size += c.compressed_size;
+        t.uncompressed_size += c.uncompressed_size;
+        t.pixels += c.pixels;
+        t.ratios += ratio;
+    }
+};
+constexpr double summary::bounds[];
+} // namespace
+
+static std::unique_ptr<writer> make_writer(jlst::info_options const& options)
+{
+    if (options.format == "yaml")
+        return std::unique_ptr<writer>(new yaml_writer(options.pretty));
+    if (options.format == "xml")
+        return std::unique_ptr<writer>(new xml_writer(options.pretty));
+    // ndjson: one compact object per line
+    return std::unique_ptr<writer>(new json_writer(options.format == "json" && options.pretty));
+}
+
+static record dump(jlst::info_options const& options, jlst::source& source, bool multiple)
+{
+    record r{};
+    std::ostringstream err;
+    auto writer = make_writer(options);
+    r.success = dump(*writer, source, r.out, err, options, r.c);
+    // ndjson: path is part of the record
+    if (multiple && options.format != "ndjson" && !r.out.empty())
+        r.out = source.get_filename() + ":\n" + r.out;
+    r.err = err.str();
+    return r;
+}
+
+// aggregate ratio (sizes summed over the inputs), and mean of the ratios of the inputs
+static void print_totals(writer& writer, std::ostream& os, std::string const& header, summary::totals const& t)
+{
+    compression c{};
+    c.compressed_size = t.compressed_size;
+    c.uncompressed_size = t.uncompressed_size;
+    c.pixels = t.pixels;
+    writer.print_header(os, header);
+    writer.print_value(os, "files", t.files);
+    writer.print_value_separator(os, false);
+    writer.print_value(os, "compressed_size", t.compressed_size);
+    writer.print_value_separator(os, false);
+    writer.print_value(os, "uncompressed_size", t.uncompressed_size);
+    writer.print_value_separator(os, false);
+    writer.print_value(os, "bits_per_pixel", c.bits_per_pixel());
+    writer.print_value_separator(os, false);
+    writer.print_value(os, "ratio", c.ratio());
+    writer.print_value_separator(os, false);
+    writer.print_value(os, "mean_ratio", t.files ? t.ratios / static_cast<double>(t.files) : 0.);
+    writer.print_value_separator(os, true);
+    writer.print_footer(os, header);
+}
+
+static std::string print_summary(jlst::info_options const& options, summary const& s)
+{
+    std::ostringstream os;
+    auto writer = make_writer(options);
+    writer->print_header(os, "");
+    const char header[] = "summary";
+    writer->print_header(os, header);
+    print_totals(*writer, os, "total", s.all);
+    writer->print_value_separator(os, false);
+    // bucket `ratio_<lower bound>` counts the inputs up to the next bound:
+    const char histogram[] = "ratio_histogram";
+    writer->print_header(os, histogram);
+    for (size_t bucket = 0; bucket < summary::bucket_count; ++bucket)
+    {
+        std::ostringstream key;
+        key << "ratio_" << summary::bounds[bucket];
+        writer->print_value(os, key.str(), s.histogram[bucket]);
+        writer->print_value_separator(os, bucket + 1 == summary::bucket_count);
+    }
+    writer->print_footer(os, histogram);
+    writer->print_value_separator(os, false);
+    const char kinds[] = "kinds";
+    writer->print_header(os, kinds);
+    size_t n = 0;
+    for (auto& kind : s.kinds)
+    {
+        print_totals(*writer, os, kind.first, kind.second);
+        writer->print_value_separator(os, ++n == s.kinds.size());
+    }
+    writer->print_footer(os, kinds);
+    writer->print_value_separator(os, true);
+    writer->print_footer(os, header);
+    writer->print_value_separator(os, true);
+    writer->print_footer(os, "");
+    os << std::endl;
+    return os.str();
+}
+
+// pick JPEG-LS files using the format signatures (see factory), then the
+// frame marker: the jls signature (SOI) also matches any other JPEG
+static bool is_jpegls(jlst::source& source)
+{
+    std::unique_ptr<jlst::format> format(jlst::factory::instance().detect_format(source));
+    return format && format->handle_type("jls") && jlst::jls::has_jpegls_frame(source);
 }
 
 int main(int argc, char* argv[])
@@ -557,44 +930,61 @@ int main(int argc, char* argv[])
     {
         auto& sources = options.get_sources();
         auto& dest = options.get_dest(0);
-        const bool multiple = sources.size() > 1;
-        for (auto& source : sources)
+        summary s{};
+        // inputs are processed concurrently, but records are written in input order:
+        jlst::reorder_buffer<record> output([&](record& r) {
+            dest.write(r.out.c_str(), r.out.size());
+            std::cerr << r.err;
+            success = r.success && success;
+            s.add(r.c);
+        });
+        if (!options.directories.empty())
         {
-            auto& filename = source.get_filename();
-            {
-                std::ostringstream os;
-                if (multiple)
-                    os << filename << ":" << std::endl;
-                const std::string s = os.str();
-                dest.write(s.c_str(), s.size());
-            }
-            if (options.format == "yaml")
-            {
-                yaml_writer writer(options.pretty);
-                success = dump(writer, source, dest, options.with_hash) && success;
-            }
-            else if (options.format == "json")
-            {
-                json_writer writer(options.pretty);
-                success = dump(writer, source, dest, options.with_hash) && success;
-            }
-            else if (options.format == "xml")
-            {
-                xml_writer writer(options.pretty);
-                success = dump(writer, source, dest, options.with_hash) && success;
-            }
+            // inventory mode: files are only opened by the worker processing them
+            std::vector<std::string> paths;
+            for (auto& directory : options.directories)
+                jlst::options::walk(directory, paths);
+            jlst::parallel::for_each(paths.size(), options.jobs, [&](size_t index, unsigned int) {
+                record r{};
+                r.success = true;
+                try
+                {
+                    jlst::source source(paths[index]);
+                    if (is_jpegls(source))
+                        r = dump(options, source, true);
+                }
+                catch (std::exception& e)
+                {
+                    r.err = paths[index] + ": " + e.what() + "\n";
+                    r.success = false;
+                }
+                output.push(index, std::move(r));
+            });
+        }
+        else
+        {
+            const bool multiple = sources.size() > 1;
+            jlst::parallel::for_each(sources.size(), options.jobs, [&](size_t index, unsigned int) {
+                output.push(index, dump(options, sources[index], multiple));
+            });
+        }
+        if (options.summary)
+        {
+            const std::string str = print_summary(options, s);
+            dest.write(str.c_str(), str.size());
         }
     }
     catch (std::exception& e)
     {
         std::cerr << "Invalid options: " << e.what() << std::endl;
-        return EXIT_FAILURE;
+        success = false;
     }
     catch (...)
     {
         std::cerr << "unknown exception during info dumping" << std::endl;
-        return EXIT_FAILURE;
+        success = false;
     }
+    jlst::stats::report();
 
     return success ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -1,30 +1,65 @@
 // Copyright (c) Mathieu Malaterre
 // SPDX-License-Identifier: BSD-3-Clause
 #include "jplsinfo_options.h"
+#include "stats.h"
 #include "version.h"
 #include <charls/charls.h>
 
+#include <algorithm>
 #include <boost/program_options.hpp>
 #include <iostream>
+#include <iterator>
 
 namespace jlst {
 
+static info_options::predicate parse_predicate(std::string const& str)
+{
+    static const char* const keys[] = {"width",         "height",          "bits_per_sample",     "component_count",
+                                       "near_lossless", "interleave_mode", "color_transformation"};
+    const auto pos = str.find_first_of("<>=!");
+    if (pos == std::string::npos || pos == 0)
+        throw std::invalid_argument("where: " + str);
+    info_options::predicate p;
+    p.key = str.substr(0, pos);
+    const auto len = (pos + 1 < str.size() && str[pos + 1] == '=') ? 2 : 1;
+    p.op = str.substr(pos, len);
+    p.value = str.substr(pos + len);
+    if (p.op == "!" || p.op == "==" || p.value.empty())
+        throw std::invalid_argument("where: " + str);
+    if (std::find(std::begin(keys), std::end(keys), p.key) == std::end(keys))
+        throw std::invalid_argument("where: unknown key " + p.key);
+    return p;
+}
+
 bool info_options::process(int argc, char* argv[])
 {
     namespace po = boost::program_options;
     {
         po::options_description desc("Allowed options");
         std::string hash_name;
+        std::string stats_file;
         std::vector<std::string> inputs{};
         std::vector<std::string> outputs{};
+        std::vector<std::string> wheres{};
         // by default unix_style includes `allow_guessing`, so that user can use abbreviation:
         desc.add_options()("help,h", "print usage message")                       // help
             ("version", "print version")                                          // version
             ("input,i", po::value(&inputs) /*->required()*/, "inputs. Required.") // input
             ("output,o", po::value(&outputs) /*->required()*/, "outputs.")        // output
-            ("format,f", po::value(&format), "format")                            // json/xml/yaml
+            ("format,f", po::value(&format), "format")                            // json/xml/yaml/ndjson
+            ("recursive,r", po::value(&directories), "walk directory, pick JPEG-LS files by signature") // inventory
+            ("where", po::value(&wheres), "only report inputs matching, eg. 'bits_per_sample>8'")   // predicates
             ("pretty", "prettify output")                                         // pretty
-            ("hash", po::value(&hash_name), "use hash (eg. 'crc32')")             // compute hash of decoded buffer
+            ("hash", po::value(&hash_name), "use hash (eg. 'crc32', 'xxh64')")    // compute hash of decoded buffer
+            ("hash-jobs", po::value(&hash_jobs), "threads hashing each image, 0 for one per core (default 1)") // hash
+            ("band-height", po::value(&band_height), "also hash each band of rows") // hash index
+            ("write-index", "save the band hashes to input.hidx")                 // sidecar
+            ("verify-index", "report bands differing from input.hidx")            // sidecar
+            ("compression", "report compressed size, bits per pixel, ratio and scan sizes (no decoding)") // ratio
+            ("summary", "append totals, ratio histogram and averages per image kind of all inputs")      // summary
+            ("jobs,j", po::value(&jobs), "number of inputs processed concurrently, 0 for one per core") // jobs
+            ("stats", "print per-phase timing statistics to stderr")                                // stats
+            ("stats-file", po::value(&stats_file), "write per-phase timing statistics as JSON to a file") // stats
             ;
 
         po::positional_options_description p;
@@ -50,12 +85,14 @@ bool info_options::process(int argc, char* argv[])
         try
         {
             po::notify(vm);
+            if (vm.count("stats") || vm.count("stats-file"))
+                stats::enable(stats_file);
 
             if (vm.count("input"))
             {
                 add_inputs(inputs);
             }
-            else
+            else if (!vm.count("recursive"))
             {
                 add_stdin_input();
             }
@@ -77,21 +114,59 @@ bool info_options::process(int argc, char* argv[])
             throw;
         }
 
+        if (vm.count("input") && vm.count("recursive"))
+        {
+            throw std::invalid_argument("recursive and input are exclusive");
+        }
+        if (format != "json" && format != "xml" && format != "yaml" && format != "ndjson")
+        {
+            throw std::invalid_argument("format: " + format);
+        }
+        for (auto& where : wheres)
+        {
+            predicates.push_back(parse_predicate(where));
+        }
         if (vm.count("pretty"))
         {
             pretty = true;
         }
         if (vm.count("hash"))
         {
-            if (hash_name == "crc32")
+            if (hash_name == "crc32" || hash_name == "xxh64")
             {
                 with_hash = true;
+                hash = hash_name;
             }
             else
             {
                 throw std::invalid_argument("hash: " + hash_name);
             }
         }
+        with_compression = vm.count("compression") != 0;
+        summary = vm.count("summary") != 0;
+        write_index = vm.count("write-index") != 0;
+        verify_index = vm.count("verify-index") != 0;
+        if (write_index && verify_index)
+        {
+            throw std::invalid_argument("write-index and verify-index are exclusive");
+        }
+        if (hash_jobs < 0)
+        {
+            throw std::invalid_argument("hash-jobs: " + std::to_string(hash_jobs));
+        }
+        if (vm.count("band-height") && band_height == 0)
+        {
+            throw std::invalid_argument("band-height: 0");
+        }
+        if (band_height || write_index || verify_index)
+        {
+            // band hashes are computed on the decoded buffer:
+            with_hash = true;
+            if (hash.empty())
+                hash = "crc32";
+            if (write_index && !band_height)
+                band_height = 64;
+        }
     } // namespace boost::program_options;
     return true;
 }
@@ -5,6 +5,7 @@
 #include "options.h"
 
 #include <string>
+#include <vector>
 
 namespace jlst {
 struct info_options final : options
@@ -15,6 +16,27 @@ struct info_options final : options
     std::string format{};
     bool pretty{};
     bool with_hash{};
+    // compressed size, bits per pixel, ratio and scan sizes of each input
+    bool with_compression{};
+    // aggregate of the compression of all the inputs
+    bool summary{};
+    std::string hash{}; // crc32 or xxh64
+    // threads hashing each decoded image (`--hash-jobs`), 0 for one per core
+    int hash_jobs{1};
+    // hash index: digest of each band of `band_height` rows (0 for none)
+    uint32_t band_height{};
+    bool write_index{};  // save the band digests next to each input
+    bool verify_index{}; // compare against the saved band digests
+    // inventory mode: directories walked recursively
+    std::vector<std::string> directories{};
+    // `--where` filters, eg. `bits_per_sample>=12`
+    struct predicate
+    {
+        std::string key;
+        std::string op;
+        std::string value;
+    };
+    std::vector<predicate> predicates{};
 
     /**
      * Returns false when the process should stop, ie `help` or `version` was passed.
@@ -5,11 +5,19 @@
 #include "format.h"  // for format
 #include "image.h"   // for image, image_info
 #include "jls.h"     // for format
+#include "jlss.h"    // for jlss
 #include "jplstran_options.h"
+#include "stats.h" // for stats
 
 #include <iostream> // for operator<<, endl, basic_ostream, cerr
 #include <memory>   // for unique_ptr
 
+static bool is_striped(jlst::source& source)
+{
+    std::unique_ptr<jlst::format> detected(jlst::factory::instance().detect_format(source));
+    return detected && detected->handle_type("jlss");
+}
+
 static void transform(jlst::tran_options& options)
 {
     if (options.jai_imageio)
@@ -24,6 +32,11 @@ static void transform(jlst::tran_options& options)
         std::unique_ptr<jlst::jls> jls_format(ptr);
         jls_format->fix_spiff(options.get_dest(0), options.get_source(0));
     }
+    else if (is_striped(options.get_source(0)))
+    {
+        jlst::jlss jlss_format(options.jobs);
+        jlss_format.transform(options.get_dest(0), options.get_source(0), options);
+    }
     else
     {
         jlst::jls* ptr = new jlst::jls;
@@ -54,6 +67,7 @@ int main(int argc, char* argv[])
         return EXIT_FAILURE;
     }
 
+    bool success = true;
     try
     {
         transform(options);
@@ -61,13 +75,14 @@ int main(int argc, char* argv[])
     catch (std::exception& e)
     {
         std::cerr << "Invalid options: " << e.what() << std::endl;
-        return EXIT_FAILURE;
+        success = false;
     }
     catch (...)
     {
         std::cerr << "unknown exception during transform" << std::endl;
-        return EXIT_FAILURE;
+        success = false;
     }
+    jlst::stats::report();
 
-    return EXIT_SUCCESS;
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
 }
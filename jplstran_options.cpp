@@ -1,6 +1,7 @@
 // Copyright (c) Mathieu Malaterre
 // SPDX-License-Identifier: BSD-3-Clause
 #include "jplstran_options.h"
+#include "stats.h"
 #include "tuple.h"
 #include "version.h"
 #include <charls/charls.h>
@@ -20,6 +21,7 @@ bool tran_options::process(int argc, char* argv[])
         std::vector<std::string> outputs{};
         region_type region_tuple;
         std::string flip;
+        std::string stats_file;
         // by default unix_style includes `allow_guessing`, so that user can use abbreviation:
         desc.add_options()("help,h", "print usage message")                       // help
             ("version", "print version")                                          // version
@@ -35,6 +37,10 @@ bool tran_options::process(int argc, char* argv[])
              "Fix JPEG-LS header (JAI-ImageIO bug)") // JAI-ImageIO
             ("standard_spiff_header", po::value(&standard_spiff_header),
              "Write a standard spiff header: 'yes'/'no'.") // spiff header
+            ("jobs,j", po::value(&jobs),
+             "Number of worker threads for the transform (and the stripes), 0 for one per core (default 1).") // jobs
+            ("stats", "Print per-phase timing statistics to stderr.")                                              // stats
+            ("stats-file", po::value(&stats_file), "Write per-phase timing statistics as JSON to a file.")         // stats
             ;
 
         po::positional_options_description p;
@@ -62,6 +68,8 @@ bool tran_options::process(int argc, char* argv[])
         try
         {
             po::notify(vm);
+            if (vm.count("stats") || vm.count("stats-file"))
+                stats::enable(stats_file);
 
             if (vm.count("input"))
             {
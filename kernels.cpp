@@ -0,0 +1,371 @@
+// Copyright (c) Mathieu Malaterre
+// SPDX-License-Identifier: BSD-3-Clause
+#include "kernels.h"
+
+#include "parallel.h"
+
+#include <algorithm> // std::swap_ranges
+#include <cstring>   // std::memcpy
+#include <type_traits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace jlst {
+namespace {
+// tile edge, in pixels: a tile of the input and its transpose (2 x 24 KiB for
+// 6 bytes pixels) stay in L2 while the input is read column wise, and each
+// output row of a tile is written as one contiguous run.
+constexpr size_t tile = 64;
+
+// `N` is the pixel size when known at compile time (fixed size moves instead
+// of a memcpy call), 0 otherwise.
+template<size_t N>
+inline void copy_pixel(uint8_t* dst, const uint8_t* src, size_t nbytes)
+{
+    std::memcpy(dst, src, N ? N : nbytes);
+}
+
+/**
+ * Layout of the output of a transpose: input pixel (r, c) goes to
+ * `origin + c * row_step + r * col_step`, with negative steps when the
+ * output rows or columns run backwards.
+ */
+struct transposed
+{
+    uint8_t* origin;
+    ptrdiff_t row_step;
+    ptrdiff_t col_step;
+
+    uint8_t* at(size_t r, size_t c) const
+    {
+        return origin + static_cast<ptrdiff_t>(c) * row_step + static_cast<ptrdiff_t>(r) * col_step;
+    }
+};
+
+template<size_t N>
+void transpose_block(const uint8_t* in, size_t in_stride, transposed const& out, size_t nbytes, size_t r0, size_t r1,
+                     size_t c0, size_t c1)
+{
+    for (size_t c = c0; c < c1; ++c)
+    {
+        for (size_t r = r0; r < r1; ++r)
+            copy_pixel<N>(out.at(r, c), in + r * in_stride + c * nbytes, nbytes);
+    }
+}
+
+#ifdef __SSE2__
+// 8x8 transposes: input rows are loaded in reverse order when the output
+// columns run backwards, so that every output row is a single forward store.
+inline void transpose8x8(const uint8_t* src, size_t stride, bool reverse, uint8_t* dst, ptrdiff_t dst_stride)
+{
+    __m128i r[8];
+    for (size_t i = 0; i < 8; ++i)
+        r[i] = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + (reverse ? 7 - i : i) * stride));
+    const __m128i a0 = _mm_unpacklo_epi8(r[0], r[1]);
+    const __m128i a1 = _mm_unpacklo_epi8(r[2], r[3]);
+    const __m128i a2 = _mm_unpacklo_epi8(r[4], r[5]);
+    const __m128i a3 = _mm_unpacklo_epi8(r[6], r[7]);
+    const __m128i b0 = _mm_unpacklo_epi16(a0, a1);
+    const __m128i b1 = _mm_unpackhi_epi16(a0, a1);
+    const __m128i b2 = _mm_unpacklo_epi16(a2, a3);
+    const __m128i b3 = _mm_unpackhi_epi16(a2, a3);
+    // each register now holds two output rows:
+    const __m128i c[4] = {_mm_unpacklo_epi32(b0, b2), _mm_unpackhi_epi32(b0, b2), _mm_unpacklo_epi32(b1, b3),
+                          _mm_unpackhi_epi32(b1, b3)};
+    for (ptrdiff_t i = 0; i < 4; ++i)
+    {
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + (2 * i) * dst_stride), c[i]);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + (2 * i + 1) * dst_stride), _mm_unpackhi_epi64(c[i], c[i]));
+    }
+}
+
+inline void transpose8x8_16(const uint8_t* src, size_t stride, bool reverse, uint8_t* dst, ptrdiff_t dst_stride)
+{
+    __m128i r[8];
+    for (size_t i = 0; i < 8; ++i)
+        r[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + (reverse ? 7 - i : i) * stride));
+    const __m128i a0 = _mm_unpacklo_epi16(r[0], r[1]);
+    const __m128i a1 = _mm_unpackhi_epi16(r[0], r[1]);
+    const __m128i a2 = _mm_unpacklo_epi16(r[2], r[3]);
+    const __m128i a3 = _mm_unpackhi_epi16(r[2], r[3]);
+    const __m128i a4 = _mm_unpacklo_epi16(r[4], r[5]);
+    const __m128i a5 = _mm_unpackhi_epi16(r[4], r[5]);
+    const __m128i a6 = _mm_unpacklo_epi16(r[6], r[7]);
+    const __m128i a7 = _mm_unpackhi_epi16(r[6], r[7]);
+    const __m128i b0 = _mm_unpacklo_epi32(a0, a2);
+    const __m128i b1 = _mm_unpackhi_epi32(a0, a2);
+    const __m128i b2 = _mm_unpacklo_epi32(a1, a3);
+    const __m128i b3 = _mm_unpackhi_epi32(a1, a3);
+    const __m128i b4 = _mm_unpacklo_epi32(a4, a6);
+    const __m128i b5 = _mm_unpackhi_epi32(a4, a6);
+    const __m128i b6 = _mm_unpacklo_epi32(a5, a7);
+    const __m128i b7 = _mm_unpackhi_epi32(a5, a7);
+    const __m128i c[8] = {_mm_unpacklo_epi64(b0, b4), _mm_unpackhi_epi64(b0, b4), _mm_unpacklo_epi64(b1, b5),
+                          _mm_unpackhi_epi64(b1, b5), _mm_unpacklo_epi64(b2, b6), _mm_unpackhi_epi64(b2, b6),
+                          _mm_unpacklo_epi64(b3, b7), _mm_unpackhi_epi64(b3, b7)};
+    for (ptrdiff_t i = 0; i < 8; ++i)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * dst_stride), c[i]);
+}
+
+// full 8x8 blocks of a tile in registers, then the ragged edges
+template<size_t N>
+void transpose_tile_sse2(const uint8_t* in, size_t in_stride, transposed const& out, bool reverse, size_t r0,
+                         size_t r1, size_t c0, size_t c1)
+{
+    const size_t r8 = r0 + (r1 - r0) / 8 * 8;
+    const size_t c8 = c0 + (c1 - c0) / 8 * 8;
+    for (size_t c = c0; c < c8; c += 8)
+    {
+        for (size_t r = r0; r < r8; r += 8)
+        {
+            const uint8_t* src = in + r * in_stride + c * N;
+            uint8_t* dst = out.at(reverse ? r + 7 : r, c);
+            if (N == 1)
+                transpose8x8(src, in_stride, reverse, dst, out.row_step);
+            else
+                transpose8x8_16(src, in_stride, reverse, dst, out.row_step);
+        }
+    }
+    transpose_block<N>(in, in_stride, out, N, r0, r1, c8, c1);
+    transpose_block<N>(in, in_stride, out, N, r8, r1, c0, c8);
+}
+#endif
+
+// input columns [first, last), ie output rows, of the transpose
+template<size_t N>
+void transpose_impl(const uint8_t* in, uint8_t* out, size_t width, size_t height, size_t nbytes, bool reverse_x,
+                    bool reverse_y, size_t first, size_t last)
+{
+    const size_t in_stride = width * nbytes;
+    const size_t out_stride = height * nbytes;
+    const ptrdiff_t pixel = static_cast<ptrdiff_t>(nbytes);
+    const transposed t{out + (reverse_y ? (width - 1) * out_stride : 0) + (reverse_x ? (height - 1) * nbytes : 0),
+                       reverse_y ? -static_cast<ptrdiff_t>(out_stride) : static_cast<ptrdiff_t>(out_stride),
+                       reverse_x ? -pixel : pixel};
+    for (size_t r0 = 0; r0 < height; r0 += tile)
+    {
+        const size_t r1 = r0 + tile < height ? r0 + tile : height;
+        for (size_t c0 = first; c0 < last; c0 += tile)
+        {
+            const size_t c1 = c0 + tile < last ? c0 + tile : last;
+#ifdef __SSE2__
+            if (N == 1 || N == 2)
+            {
+                transpose_tile_sse2<N>(in, in_stride, t, reverse_x, r0, r1, c0, c1);
+                continue;
+            }
+#endif
+            transpose_block<N>(in, in_stride, t, nbytes, r0, r1, c0, c1);
+        }
+    }
+}
+
+// out[x] = in[width - 1 - x]
+template<size_t N>
+inline void reverse_row(const uint8_t* in, uint8_t* out, size_t width, size_t nbytes)
+{
+    const uint8_t* src = in + (width - 1) * nbytes;
+    for (size_t x = 0; x < width; ++x, out += nbytes, src -= nbytes)
+        copy_pixel<N>(out, src, nbytes);
+}
+
+template<size_t N>
+inline void swap_pixel(uint8_t* a, uint8_t* b, size_t nbytes)
+{
+    std::swap_ranges(a, a + (N ? N : nbytes), b);
+}
+
+// reverses the order of `count` pixels in place
+template<size_t N>
+inline void reverse_in_place(uint8_t* data, size_t count, size_t nbytes)
+{
+    if (count < 2)
+        return;
+    for (uint8_t *a = data, *b = data + (count - 1) * nbytes; a < b; a += nbytes, b -= nbytes)
+        swap_pixel<N>(a, b, nbytes);
+}
+
+/**
+ * Calls `fn(std::integral_constant<size_t, N>())` with N the pixel size for
+ * the common layouts (8/16 bits gray, 8/16 bits RGB, 4 bytes pixels), and
+ * N = 0 (runtime size) otherwise. The pixel size is dispatched once per
+ * image, inner loops are instantiated for each fixed size.
+ */
+template<typename F>
+void dispatch(size_t nbytes, F&& fn)
+{
+    switch (nbytes)
+    {
+    case 1:
+        return fn(std::integral_constant<size_t, 1>());
+    case 2:
+        return fn(std::integral_constant<size_t, 2>());
+    case 3:
+        return fn(std::integral_constant<size_t, 3>());
+    case 4:
+        return fn(std::integral_constant<size_t, 4>());
+    case 6:
+        return fn(std::integral_constant<size_t, 6>());
+    default:
+        return fn(std::integral_constant<size_t, 0>());
+    }
+}
+
+// [begin, end) of [pos, pos + size) clamped to [0, limit)
+inline void clamp(size_t pos, size_t size, size_t limit, size_t& begin, size_t& end)
+{
+    begin = pos < limit ? pos : limit;
+    end = size < limit - begin ? begin + size : limit;
+}
+
+/**
+ * Calls `fn(begin, end)` for bands of rows covering [0, rows) on up to `jobs`
+ * threads. Bands are about 64 KiB of `row_size` bytes rows, so that a task
+ * is worth a thread hand-off and threads only share the cache lines at the
+ * edges of their bands.
+ */
+template<typename F>
+void for_each_band(size_t rows, size_t row_size, int jobs, F&& fn)
+{
+    const size_t band = row_size < 65536 ? 65536 / (row_size + 1) + 1 : 1;
+    parallel::for_each((rows + band - 1) / band, jobs, [&](size_t index, unsigned int) {
+        const size_t begin = index * band;
+        fn(begin, begin + band < rows ? begin + band : rows);
+    });
+}
+} // namespace
+
+void kernels::transpose(const uint8_t* in, uint8_t* out, size_t width, size_t height, size_t nbytes, bool reverse_x,
+                        bool reverse_y, int jobs)
+{
+    if (width == 0 || height == 0)
+        return;
+    // each task writes whole output rows (one band of tile columns of the input):
+    dispatch(nbytes, [&](auto size) {
+        parallel::for_each((width + tile - 1) / tile, jobs, [&](size_t band, unsigned int) {
+            const size_t first = band * tile;
+            const size_t last = first + tile < width ? first + tile : width;
+            transpose_impl<decltype(size)::value>(in, out, width, height, nbytes, reverse_x, reverse_y, first, last);
+        });
+    });
+}
+
+void kernels::rotate180(const uint8_t* in, uint8_t* out, size_t width, size_t height, size_t nbytes, int jobs)
+{
+    if (width == 0)
+        return;
+    const size_t stride = width * nbytes;
+    dispatch(nbytes, [&](auto size) {
+        for_each_band(height, stride, jobs, [&](size_t begin, size_t end) {
+            for (size_t y = begin; y < end; ++y)
+                reverse_row<decltype(size)::value>(in + (height - 1 - y) * stride, out + y * stride, width, nbytes);
+        });
+    });
+}
+
+void kernels::flip(const uint8_t* in, uint8_t* out, size_t width, size_t height, size_t nbytes, bool vertical, int jobs)
+{
+    if (width == 0)
+        return;
+    const size_t stride = width * nbytes;
+    if (vertical)
+    {
+        for_each_band(height, stride, jobs, [&](size_t begin, size_t end) {
+            for (size_t y = begin; y < end; ++y)
+                std::memcpy(out + y * stride, in + (height - 1 - y) * stride, stride);
+        });
+        return;
+    }
+    dispatch(nbytes, [&](auto size) {
+        for_each_band(height, stride, jobs, [&](size_t begin, size_t end) {
+            for (size_t y = begin; y < end; ++y)
+                reverse_row<decltype(size)::value>(in + y * stride, out + y * stride, width, nbytes);
+        });
+    });
+}
+
+void kernels::rotate180(uint8_t* data, size_t width, size_t height, size_t nbytes, int jobs)
+{
+    if (width == 0)
+        return;
+    // row y and row height - 1 - y are swapped and reversed together, the
+    // middle row of an odd height is reversed on its own:
+    const size_t stride = width * nbytes;
+    dispatch(nbytes, [&](auto size) {
+        for_each_band((height + 1) / 2, 2 * stride, jobs, [&](size_t begin, size_t end) {
+            for (size_t y = begin; y < end; ++y)
+            {
+                uint8_t* top = data + y * stride;
+                uint8_t* bottom = data + (height - 1 - y) * stride;
+                if (top == bottom)
+                {
+                    reverse_in_place<decltype(size)::value>(top, width, nbytes);
+                    continue;
+                }
+                uint8_t* b = bottom + stride - nbytes;
+                for (size_t x = 0; x < width; ++x, b -= nbytes)
+                    swap_pixel<decltype(size)::value>(top + x * nbytes, b, nbytes);
+            }
+        });
+    });
+}
+
+void kernels::flip(uint8_t* data, size_t width, size_t height, size_t nbytes, bool vertical, int jobs)
+{
+    const size_t stride = width * nbytes;
+    if (vertical)
+    {
+        for_each_band(height / 2, 2 * stride, jobs, [&](size_t begin, size_t end) {
+            for (size_t y = begin; y < end; ++y)
+                std::swap_ranges(data + y * stride, data + (y + 1) * stride, data + (height - 1 - y) * stride);
+        });
+        return;
+    }
+    dispatch(nbytes, [&](auto size) {
+        for_each_band(height, stride, jobs, [&](size_t begin, size_t end) {
+            for (size_t y = begin; y < end; ++y)
+                reverse_in_place<decltype(size)::value>(data + y * stride, width, nbytes);
+        });
+    });
+}
+
+void kernels::crop(const uint8_t* in, uint8_t* out, size_t width, size_t height, size_t nbytes, size_t x, size_t y,
+                   size_t crop_width, size_t crop_height, int jobs)
+{
+    // rows of the region are contiguous, the part outside the input is left untouched:
+    size_t x0, x1, y0, y1;
+    clamp(x, crop_width, width, x0, x1);
+    clamp(y, crop_height, height, y0, y1);
+    if (x0 == x1)
+        return;
+    const size_t size = (x1 - x0) * nbytes;
+    if (jobs == 1)
+    {
+        // in place, a row may overwrite the input of the previous rows, move them in order:
+        for (size_t row = y0; row < y1; ++row)
+            std::memmove(out + (row - y) * crop_width * nbytes, in + (row * width + x0) * nbytes, size);
+        return;
+    }
+    for_each_band(y1 - y0, size, jobs, [&](size_t begin, size_t end) {
+        for (size_t row = y0 + begin; row < y0 + end; ++row)
+            std::memcpy(out + (row - y) * crop_width * nbytes, in + (row * width + x0) * nbytes, size);
+    });
+}
+
+void kernels::wipe(const uint8_t* in, uint8_t* out, size_t width, size_t height, size_t nbytes, size_t x, size_t y,
+                   size_t wipe_width, size_t wipe_height, int jobs)
+{
+    const size_t stride = width * nbytes;
+    size_t x0, x1, y0, y1;
+    clamp(x, wipe_width, width, x0, x1);
+    clamp(y, wipe_height, height, y0, y1);
+    for_each_band(height, stride, jobs, [&](size_t begin, size_t end) {
+        if (out != in)
+            std::memcpy(out + begin * stride, in + begin * stride, (end - begin) * stride);
+        for (size_t row = begin < y0 ? y0 : begin; row < end && row < y1; ++row)
+            std::memset(out + row * stride + x0 * nbytes, 0, (x1 - x0) * nbytes);
+    });
+}
+} // namespace jlst
@@ -0,0 +1,51 @@
+// Copyright (c) Mathieu Malaterre
+// SPDX-License-Identifier: BSD-3-Clause
+#pragma once
+
+#include <cstddef> // std::size_t
+#include <cstdint>
+
+namespace jlst {
+/**
+ * Pixel kernels of the geometric transforms (see image.cpp), operating on a
+ * single plane of `nbytes` bytes pixels. The pixel size is dispatched once per
+ * call to loops specialized for 1, 2, 3, 4 and 6 bytes pixels. The work is
+ * split across `jobs` threads (0 for one per core): bands of rows, or bands
+ * of output rows for the transposes, so that threads do not write to the
+ * same cache lines.
+ */
+struct kernels final
+{
+    /**
+     * Writes the transpose of the `width` x `height` plane `in` (pixels of
+     * `nbytes` bytes) to `out`, which is `height` pixels wide:
+     *   out(y, x) = in(reverse_x ? height - 1 - x : x, reverse_y ? width - 1 - y : y)
+     * so that transpose, transverse, rotate 90 and rotate 270 share the same
+     * cache-blocked kernel. 1 and 2 bytes pixels use an in-register 8x8
+     * transpose when SSE2 is available.
+     */
+    static void transpose(const uint8_t* in, uint8_t* out, size_t width, size_t height, size_t nbytes, bool reverse_x,
+                          bool reverse_y, int jobs = 1);
+
+    // out(y, x) = in(height - 1 - y, width - 1 - x)
+    static void rotate180(const uint8_t* in, uint8_t* out, size_t width, size_t height, size_t nbytes, int jobs = 1);
+    // out(y, x) = in(height - 1 - y, x) when vertical, in(y, width - 1 - x) otherwise
+    static void flip(const uint8_t* in, uint8_t* out, size_t width, size_t height, size_t nbytes, bool vertical,
+                     int jobs = 1);
+    // in place variants, pixels are swapped pairwise
+    static void rotate180(uint8_t* data, size_t width, size_t height, size_t nbytes, int jobs = 1);
+    static void flip(uint8_t* data, size_t width, size_t height, size_t nbytes, bool vertical, int jobs = 1);
+
+    /**
+     * Copies the region at (`x`, `y`) to `out`, which is `crop_width` pixels
+     * wide. Pixels of the region outside of the input are left untouched.
+     * With a single job, `out` may alias `in` (rows are moved forward) when
+     * the region is inside the input.
+     */
+    static void crop(const uint8_t* in, uint8_t* out, size_t width, size_t height, size_t nbytes, size_t x, size_t y,
+                     size_t crop_width, size_t crop_height, int jobs = 1);
+    // copy of `in` where the region at (`x`, `y`) is set to 0, `out` may be `in`
+    static void wipe(const uint8_t* in, uint8_t* out, size_t width, size_t height, size_t nbytes, size_t x, size_t y,
+                     size_t wipe_width, size_t wipe_height, int jobs = 1);
+};
+} // namespace jlst
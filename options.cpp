@@ -2,6 +2,12 @@
 // SPDX-License-Identifier: BSD-3-Clause
 #include "options.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <dirent.h>
+#include <iomanip>
+#include <sstream>
+#include <sys/stat.h>
 #include <unistd.h>
 
 namespace jlst {
@@ -36,6 +42,77 @@ std::string options::compute_type_from_filenames(std::vector<std::string> const&
     throw std::runtime_error("compute_type_from_outputs no file extension");
 }
 
+std::string options::compute_type_from_filename(std::string const& filename)
+{
+    auto pos = filename.rfind('.');
+    if (pos != std::string::npos && filename.find('/', pos) == std::string::npos)
+    {
+        return filename.substr(pos + 1);
+    }
+    return std::string();
+}
+
+void options::walk(std::string const& directory, std::vector<std::string>& paths)
+{
+    DIR* dir = opendir(directory.c_str());
+    if (!dir)
+        throw std::invalid_argument("cannot open directory: " + directory);
+    std::vector<std::string> names;
+    while (struct dirent* entry = readdir(dir))
+    {
+        const std::string name = entry->d_name;
+        if (name != "." && name != "..")
+            names.push_back(name);
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+    for (auto& name : names)
+    {
+        const std::string path = directory.back() == '/' ? directory + name : directory + '/' + name;
+        struct stat st;
+        if (lstat(path.c_str(), &st) != 0)
+            continue;
+        if (S_ISDIR(st.st_mode))
+            walk(path, paths);
+        else if (S_ISREG(st.st_mode))
+            paths.push_back(path);
+    }
+}
+
+void options::add_stdin_batch()
+{
+    // NUL separated list: input\0output\0input\0output\0...
+    if (is_stdin_connected_to_terminal())
+        throw std::invalid_argument("missing batch list");
+    std::vector<std::string> filenames;
+    std::string filename;
+    int c;
+    while ((c = std::getchar()) != EOF)
+    {
+        if (c == '\0')
+        {
+            filenames.push_back(filename);
+            filename.clear();
+        }
+        else
+        {
+            filename += static_cast<char>(c);
+        }
+    }
+    if (!filename.empty())
+        filenames.push_back(filename);
+    if (filenames.size() % 2 != 0)
+        throw std::invalid_argument("batch list requires input/output pairs");
+    std::vector<std::string> inputs;
+    std::vector<std::string> outputs;
+    for (size_t i = 0; i < filenames.size(); i += 2)
+    {
+        inputs.push_back(filenames[i]);
+        outputs.push_back(filenames[i + 1]);
+    }
+    add_batch(inputs, outputs);
+}
+
 source& options::get_source(int index)
 {
     return sources[index];
@@ -46,4 +123,46 @@ dest& options::get_dest(int index)
     return dests[index];
 }
 
+std::string options::escape_json(std::string const& s)
+{
+    std::ostringstream o;
+    for (auto c = s.cbegin(); c != s.cend(); c++)
+    {
+        switch (*c)
+        {
+        case '"':
+            o << "\\\"";
+            break;
+        case '\\':
+            o << "\\\\";
+            break;
+        case '\b':
+            o << "\\b";
+            break;
+        case '\f':
+            o << "\\f";
+            break;
+        case '\n':
+            o << "\\n";
+            break;
+        case '\r':
+            o << "\\r";
+            break;
+        case '\t':
+            o << "\\t";
+            break;
+        default:
+            if ('\x00' <= *c && *c <= '\x1f')
+            {
+                o << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(*c);
+            }
+            else
+            {
+                o << *c;
+            }
+        }
+    }
+    return o.str();
+}
+
 } // end namespace jlst
@@ -7,6 +7,7 @@
 
 #include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace jlst {
@@ -20,6 +21,30 @@ struct options
         return sources;
     }
 
+    // batch mode: each (input, output) pair is an independent job, files are
+    // only opened when the job is processed.
+    bool is_batch() const
+    {
+        return batch_;
+    }
+    const std::vector<std::pair<std::string, std::string>>& get_batch() const
+    {
+        return batch_files;
+    }
+    // number of worker threads (`-j`), 0 means one per core
+    int jobs{1};
+
+    // file extension or empty string when there is none
+    static std::string compute_type_from_filename(std::string const& filename);
+
+    // appends the regular files below `directory` to `paths`: depth-first walk,
+    // entries sorted by name, symbolic links are not followed
+    static void walk(std::string const& directory, std::vector<std::string>& paths);
+
+    // `s` as the content of a JSON string: quotes, backslashes and control
+    // characters escaped (FIXME assume input is UTF-8)
+    static std::string escape_json(std::string const& s);
+
 protected:
     void add_inputs(std::vector<std::string> const& inputs)
     {
@@ -58,6 +83,18 @@ protected:
         }
     }
 
+    void add_batch(std::vector<std::string> const& inputs, std::vector<std::string> const& outputs)
+    {
+        if (inputs.size() != outputs.size())
+            throw std::invalid_argument("batch requires as many inputs as outputs");
+        batch_ = true;
+        for (size_t i = 0; i < inputs.size(); ++i)
+        {
+            batch_files.push_back(std::make_pair(inputs[i], outputs[i]));
+        }
+    }
+    void add_stdin_batch();
+
     static std::string compute_type_from_filenames(std::vector<std::string> const& filenames);
 
 private:
@@ -65,5 +102,7 @@ private:
     static bool is_stdout_connected_to_terminal();
     std::vector<source> sources{};
     std::vector<dest> dests{};
+    bool batch_{};
+    std::vector<std::pair<std::string, std::string>> batch_files{};
 };
 } // namespace jlst
@@ -0,0 +1,69 @@
+// Copyright (c) Mathieu Malaterre
+// SPDX-License-Identifier: BSD-3-Clause
+#include "parallel.h"
+
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace jlst {
+unsigned int parallel::concurrency(int jobs)
+{
+    if (jobs < 0)
+        throw std::invalid_argument("jobs");
+    if (jobs == 0)
+    {
+        const unsigned int n = std::thread::hardware_concurrency();
+        return n == 0 ? 1 : n;
+    }
+    return static_cast<unsigned int>(jobs);
+}
+
+void parallel::for_each(size_t count, int jobs, std::function<void(size_t index, unsigned int worker)> const& fn)
+{
+    unsigned int nthreads = concurrency(jobs);
+    if (nthreads > count)
+        nthreads = static_cast<unsigned int>(count);
+    if (nthreads <= 1)
+    {
+        // no need to spawn anything:
+        for (size_t index = 0; index < count; ++index)
+            fn(index, 0);
+        return;
+    }
+
+    std::atomic<size_t> next{0};
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto work = [&](unsigned int worker) {
+        for (size_t index = next++; index < count && !failed; index = next++)
+        {
+            try
+            {
+                fn(index, worker);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error)
+                    error = std::current_exception();
+                failed = true;
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    threads.reserve(nthreads - 1);
+    for (unsigned int worker = 1; worker < nthreads; ++worker)
+        threads.emplace_back(work, worker);
+    // calling thread is worker 0:
+    work(0);
+    for (auto& thread : threads)
+        thread.join();
+    if (error)
+        std::rethrow_exception(error);
+}
+} // namespace jlst
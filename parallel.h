@@ -0,0 +1,60 @@
+// Copyright (c) Mathieu Malaterre
+// SPDX-License-Identifier: BSD-3-Clause
+#pragma once
+
+#include <cstddef> // for size_t
+#include <functional>
+#include <map>
+#include <mutex>
+#include <utility>
+
+namespace jlst {
+struct parallel final
+{
+    // number of worker threads for a `-j` value, 0 means one per core
+    static unsigned int concurrency(int jobs);
+
+    /**
+     * Calls `fn(index, worker)` for every index in [0, count) using up to
+     * `jobs` worker threads. Indices are handed out in increasing order as
+     * workers become available; `worker` is in [0, concurrency(jobs)) and can
+     * be used to address per-worker state. The first exception thrown by `fn`
+     * stops the distribution of new indices and is rethrown once all workers
+     * have returned.
+     */
+    static void for_each(size_t count, int jobs, std::function<void(size_t index, unsigned int worker)> const& fn);
+};
+
+/**
+ * Reorder buffer: results pushed in any order by workers are handed to
+ * `sink` strictly in index order, so that the output of a parallel run is
+ * identical to the serial one. Indices must be contiguous starting at 0.
+ */
+template<typename T>
+class reorder_buffer
+{
+public:
+    explicit reorder_buffer(std::function<void(T&)> sink) : sink_(std::move(sink))
+    {
+    }
+
+    void push(size_t index, T value)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_.emplace(index, std::move(value));
+        auto it = pending_.begin();
+        while (it != pending_.end() && it->first == next_)
+        {
+            sink_(it->second);
+            it = pending_.erase(it);
+            ++next_;
+        }
+    }
+
+private:
+    std::function<void(T&)> sink_;
+    std::mutex mutex_;
+    std::map<size_t, T> pending_;
+    size_t next_{};
+};
+} // namespace jlst
@@ -6,6 +6,7 @@
 #include "factory.h"
 #include "image.h"
 #include "source.h"
+#include "stats.h"
 #include "utils.h"
 
 #include <limits>
@@ -17,11 +18,6 @@ bool pnm::handle_type(std::string const& type) const
 {
     return type == "pam" || type == "pgm" || type == "ppm";
 }
-bool pnm::detect(source& s, image_info const&) const
-{
-    const int c = s.peek();
-    return c == 'P';
-}
 
 namespace {
 // Return 12 for input `4095`
@@ -187,10 +183,9 @@ void pnm::read_data(source& fs, image& img) const
     auto& ii = img.get_image_info();
     if (ii.frame_info().bits_per_sample > 8)
     {
-        for (size_t i{}; i < len - 1; i += 2)
-        {
-            std::swap(buf8[i], buf8[i + 1]);
-        }
+        // pnm samples are big endian:
+        stats::scope scope(stats::transform, len, len);
+        utils::byteswap16(buf8, buf8, len);
     }
 }
 
@@ -227,24 +222,25 @@ void pnm::write_data(dest& fs, const image& img, jls_options const&) const
     auto& pd = id.pixel_data();
 
     auto len = pd.size();
-    std::vector<unsigned char> buf8(pd);
-    auto const bytes_per_sample{(ii.frame_info().bits_per_sample + 7) / 8};
-    const size_t stride = ii.frame_info().width * bytes_per_sample * ii.frame_info().component_count;
-    if (ii.frame_info().component_count == 3)
+    const bool swap = ii.frame_info().bits_per_sample > 8;
+    if (ii.frame_info().component_count != 3 || ii.interleave_mode() != charls::interleave_mode::none)
     {
-        if (ii.interleave_mode() == charls::interleave_mode::none)
-        {
-            std::vector<unsigned char> copy = utils::planar_to_triplet(buf8, ii.frame_info().width, ii.frame_info().height,
-                                                                       ii.frame_info().bits_per_sample, stride);
-            buf8.assign(copy.begin(), copy.end());
-        }
+        // already in pnm layout, write the pixel data as is (big endian samples):
+        if (swap)
+            utils::write_byteswap16(fs, pd.data(), len);
+        else
+            fs.write(pd.data(), len);
+        return;
     }
-    if (ii.frame_info().bits_per_sample > 8)
+    byte_buffer buf8(len);
     {
-        for (size_t i{}; i < len - 1; i += 2)
-        {
-            std::swap(buf8[i], buf8[i + 1]);
-        }
+        stats::scope scope(stats::transform, len, len);
+        auto const bytes_per_sample{(ii.frame_info().bits_per_sample + 7) / 8};
+        const size_t stride = ii.frame_info().width * bytes_per_sample * ii.frame_info().component_count;
+        utils::planar_to_triplet(pd.data(), buf8.data(), ii.frame_info().width, ii.frame_info().height,
+                                 ii.frame_info().bits_per_sample, stride);
+        if (swap)
+            utils::byteswap16(buf8.data(), buf8.data(), len);
     }
     fs.write(buf8.data(), buf8.size());
 }
@@ -261,4 +257,12 @@ static const format* get()
 }
 
 static bool b = factory::instance().register_format(get());
+// binary variants only, P1..P4 are registered to report a meaningful error:
+static bool s1 = factory::instance().register_signature(get(), "P1");
+static bool s2 = factory::instance().register_signature(get(), "P2");
+static bool s3 = factory::instance().register_signature(get(), "P3");
+static bool s4 = factory::instance().register_signature(get(), "P4");
+static bool s5 = factory::instance().register_signature(get(), "P5");
+static bool s6 = factory::instance().register_signature(get(), "P6");
+static bool s7 = factory::instance().register_signature(get(), "P7");
 } // namespace jlst
@@ -10,7 +10,6 @@ class pnm : public format
 public:
     format* clone() const override;
     bool handle_type(std::string const& type) const override;
-    bool detect(source& s, image_info const& ii) const override;
 
     void read_info(source& s, image& i) const override;
     void read_data(source& s, image& i) const override;
@@ -5,6 +5,7 @@
 #include "factory.h"
 #include "image.h"
 #include "source.h"
+#include "utils.h"
 
 #include <cassert>
 #include <charls/charls.h>
@@ -90,15 +91,10 @@ void raw::write_data(dest& fs, const image& img, const jls_options&) const
     auto& id = img.get_image_data();
     auto& pd = id.pixel_data();
     auto len = pd.size();
-    std::vector<unsigned char> buf8(pd);
     if (ii.frame_info().bits_per_sample > 8)
-    {
-        for (size_t i{}; i < len - 1; i += 2)
-        {
-            std::swap(buf8[i], buf8[i + 1]);
-        }
-    }
-    fs.write(buf8.data(), buf8.size());
+        utils::write_byteswap16(fs, pd.data(), len);
+    else
+        fs.write(pd.data(), len);
 }
 
 format* raw::clone() const
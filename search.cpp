@@ -0,0 +1,253 @@
+// Copyright (c) Mathieu Malaterre
+// SPDX-License-Identifier: BSD-3-Clause
+#include "search.h"
+
+#include "dest.h"
+#include "image.h"
+#include "jls.h"
+#include "parallel.h"
+#include "source.h"
+#include "tuple.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+namespace jlst {
+namespace {
+// number of bands of the sample, spread over the image height
+const uint32_t sample_bands = 8;
+
+// copy of `sample_rows` rows of `i`, taken from evenly spaced bands
+image sample(const image& i, uint32_t sample_rows)
+{
+    auto& frame_info = i.get_image_info().frame_info();
+    const size_t pixel_size = static_cast<size_t>(frame_info.component_count) * ((frame_info.bits_per_sample + 7) / 8);
+    const size_t planes = i.get_image_info().interleave_mode() == charls::interleave_mode::none
+                              ? static_cast<size_t>(frame_info.component_count)
+                              : 1;
+    const size_t row_size = frame_info.width * pixel_size / planes;
+    const size_t stride = planes == 1 && i.get_image_data().stride() ? i.get_image_data().stride() : row_size;
+    const size_t plane_size = stride * frame_info.height;
+    const uint32_t nbands = std::min(sample_bands, sample_rows);
+    const uint32_t band_rows = sample_rows / nbands;
+    const size_t height = static_cast<size_t>(nbands) * band_rows;
+
+    image ret;
+    ret.get_image_info() = i.get_image_info();
+    ret.get_image_info().frame_info().height = static_cast<uint32_t>(height);
+    auto& out = ret.get_image_data().pixel_data();
+    out.resize(planes * height * row_size);
+    const auto& in = i.get_image_data().pixel_data();
+    for (uint32_t band = 0; band < nbands; ++band)
+    {
+        const size_t y = nbands == 1 ? 0 : (frame_info.height - band_rows) * static_cast<size_t>(band) / (nbands - 1);
+        for (size_t plane = 0; plane < planes; ++plane)
+            for (size_t row = 0; row < band_rows; ++row)
+                std::memcpy(out.data() + (plane * height + band * band_rows + row) * row_size,
+                            in.data() + plane * plane_size + (y + row) * stride, row_size);
+    }
+    return ret;
+}
+
+// thresholds of ISO/IEC 14495-1, C.2.4.1.1
+int clamp(int i, int j, int maximum_sample_value)
+{
+    return i > maximum_sample_value || i < j ? j : i;
+}
+
+charls::jpegls_pc_parameters default_parameters(int maximum_sample_value, int near_lossless)
+{
+    charls::jpegls_pc_parameters pcp{};
+    pcp.maximum_sample_value = maximum_sample_value;
+    if (maximum_sample_value >= 128)
+    {
+        const int factor = (std::min(maximum_sample_value, 4095) + 128) / 256;
+        pcp.threshold1 = clamp(factor * (3 - 2) + 2 + 3 * near_lossless, near_lossless + 1, maximum_sample_value);
+        pcp.threshold2 = clamp(factor * (7 - 3) + 3 + 5 * near_lossless, pcp.threshold1, maximum_sample_value);
+        pcp.threshold3 = clamp(factor * (21 - 4) + 4 + 7 * near_lossless, pcp.threshold2, maximum_sample_value);
+    }
+    else
+    {
+        const int factor = 256 / (maximum_sample_value + 1);
+        pcp.threshold1 =
+            clamp(std::max(2, 3 / factor + 3 * near_lossless), near_lossless + 1, maximum_sample_value);
+        pcp.threshold2 = clamp(std::max(3, 7 / factor + 5 * near_lossless), pcp.threshold1, maximum_sample_value);
+        pcp.threshold3 = clamp(std::max(4, 21 / factor + 7 * near_lossless), pcp.threshold2, maximum_sample_value);
+    }
+    pcp.reset_value = 64;
+    return pcp;
+}
+
+// candidate collection, ignoring duplicates and keeping the thresholds in their valid range
+class candidates
+{
+public:
+    candidates(const jls_options& jo, int maximum_sample_value)
+        : jo_(jo), maximum_sample_value_(maximum_sample_value)
+    {
+    }
+
+    void add(int threshold1, int threshold2, int threshold3, int reset_value)
+    {
+        jls_options jo = jo_;
+        auto& pcp = jo.preset_coding_parameters;
+        pcp.threshold1 = std::min(std::max(threshold1, jo_.near_lossless + 1), maximum_sample_value_);
+        pcp.threshold2 = std::min(std::max(threshold2, pcp.threshold1), maximum_sample_value_);
+        pcp.threshold3 = std::min(std::max(threshold3, pcp.threshold2), maximum_sample_value_);
+        pcp.reset_value = std::min(std::max(reset_value, 3), std::max(255, maximum_sample_value_));
+        for (auto& c : list_)
+        {
+            auto& other = c.preset_coding_parameters;
+            if (other.threshold1 == pcp.threshold1 && other.threshold2 == pcp.threshold2 &&
+                other.threshold3 == pcp.threshold3 && other.reset_value == pcp.reset_value)
+                return;
+        }
+        list_.push_back(jo);
+    }
+    std::vector<jls_options> const& list() const
+    {
+        return list_;
+    }
+
+private:
+    jls_options jo_;
+    int maximum_sample_value_;
+    std::vector<jls_options> list_;
+};
+} // namespace
+
+size_t search::smallest(const image& i, std::vector<jls_options> const& candidates, uint32_t sample_rows, int jobs)
+{
+    if (candidates.empty())
+        throw std::invalid_argument("search: no candidate");
+    const image* trial_image = &i;
+    image sampled;
+    if (sample_rows != 0 && sample_rows < i.get_image_info().frame_info().height)
+    {
+        sampled = sample(i, sample_rows);
+        trial_image = &sampled;
+    }
+    // one codestream buffer per worker, reused across its trials:
+    std::vector<byte_buffer> buffers(parallel::concurrency(jobs));
+    std::vector<size_t> sizes(candidates.size());
+    parallel::for_each(candidates.size(), jobs, [&](size_t index, unsigned int worker) {
+        auto& buffer = buffers[worker];
+        jls::encode(*trial_image, candidates[index], buffer);
+        sizes[index] = buffer.size();
+    });
+    return static_cast<size_t>(std::min_element(sizes.begin(), sizes.end()) - sizes.begin());
+}
+
+jls_options search::coding_mode(const image& i, const jls_options& jo, uint32_t sample_rows, int jobs)
+{
+    auto& frame_info = i.get_image_info().frame_info();
+    const auto input_mode = i.get_image_info().interleave_mode();
+    static const charls::interleave_mode modes[] = {charls::interleave_mode::none, charls::interleave_mode::line,
+                                                    charls::interleave_mode::sample};
+    static const charls::color_transformation transformations[] = {
+        charls::color_transformation::none, charls::color_transformation::hp1, charls::color_transformation::hp2,
+        charls::color_transformation::hp3};
+    const bool can_transform =
+        frame_info.component_count == 3 && (frame_info.bits_per_sample == 8 || frame_info.bits_per_sample == 16);
+
+    std::vector<jls_options> candidates;
+    jls_options reference = jo;
+    reference.has_interleave_mode = true;
+    reference.interleave_mode = jo.has_interleave_mode ? jo.interleave_mode : input_mode;
+    candidates.push_back(reference);
+    for (auto mode : modes)
+    {
+        // single component images are only encoded with interleave mode none:
+        if ((jo.has_interleave_mode && mode != jo.interleave_mode) ||
+            (frame_info.component_count == 1 && mode != charls::interleave_mode::none))
+            continue;
+        for (auto transformation : transformations)
+        {
+            const bool legal = transformation == charls::color_transformation::none ||
+                               (can_transform && mode != charls::interleave_mode::none);
+            if (jo.has_color_transformation ? transformation != jo.color_transformation : !legal)
+                continue;
+            if (mode == reference.interleave_mode && transformation == reference.color_transformation)
+                continue;
+            jls_options candidate = jo;
+            candidate.has_interleave_mode = true;
+            candidate.interleave_mode = mode;
+            // no APP8 marker for 'none', unless requested:
+            candidate.has_color_transformation =
+                jo.has_color_transformation || transformation != charls::color_transformation::none;
+            candidate.color_transformation = transformation;
+            candidates.push_back(candidate);
+        }
+    }
+    return candidates[smallest(i, candidates, sample_rows, jobs)];
+}
+
+charls::jpegls_pc_parameters search::preset_coding_parameters(const image& i, const jls_options& jo,
+                                                              uint32_t sample_rows, int jobs)
+{
+    const int maximum_sample_value = jo.preset_coding_parameters.maximum_sample_value
+                                         ? jo.preset_coding_parameters.maximum_sample_value
+                                         : (1 << i.get_image_info().frame_info().bits_per_sample) - 1;
+    const auto defaults = default_parameters(maximum_sample_value, jo.near_lossless);
+
+    // thresholds scaled together (in eighths), the defaults first:
+    static const int scales[] = {8, 4, 6, 12, 16, 24, 32};
+    static const int reset_values[] = {64, 32, 128, 255};
+    candidates first(jo, maximum_sample_value);
+    for (int reset_value : reset_values)
+        for (int scale : scales)
+            first.add(defaults.threshold1 * scale / 8, defaults.threshold2 * scale / 8, defaults.threshold3 * scale / 8,
+                      reset_value);
+    const auto best = first.list()[smallest(i, first.list(), sample_rows, jobs)].preset_coding_parameters;
+
+    // then each threshold on its own, the best set first:
+    static const int steps[] = {4, 6, 10, 12, 16};
+    candidates second(jo, maximum_sample_value);
+    second.add(best.threshold1, best.threshold2, best.threshold3, best.reset_value);
+    for (int step : steps)
+    {
+        second.add(best.threshold1 * step / 8, best.threshold2, best.threshold3, best.reset_value);
+        second.add(best.threshold1, best.threshold2 * step / 8, best.threshold3, best.reset_value);
+        second.add(best.threshold1, best.threshold2, best.threshold3 * step / 8, best.reset_value);
+    }
+    return second.list()[smallest(i, second.list(), sample_rows, jobs)].preset_coding_parameters;
+}
+
+void search::save_preset_coding_parameters(dest& d, charls::jpegls_pc_parameters const& pcp)
+{
+    std::ostringstream os;
+    os << "# maximum_sample_value,threshold1,threshold2,threshold3,reset_value\n";
+    os << pcp.maximum_sample_value << ',' << pcp.threshold1 << ',' << pcp.threshold2 << ',' << pcp.threshold3 << ','
+       << pcp.reset_value << '\n';
+    const std::string str = os.str();
+    d.write(str.data(), str.size());
+}
+
+charls::jpegls_pc_parameters search::load_preset_coding_parameters(source& s)
+{
+    const auto view = s.map();
+    std::istringstream is(std::string(reinterpret_cast<const char*>(view.data()), view.size()));
+    std::string line;
+    while (std::getline(is, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream ls(line);
+        tuple<int, 5> pcp{};
+        if (!(ls >> pcp))
+            break;
+        const int* val = pcp.values;
+        charls::jpegls_pc_parameters ret{};
+        ret.maximum_sample_value = val[0];
+        ret.threshold1 = val[1];
+        ret.threshold2 = val[2];
+        ret.threshold3 = val[3];
+        ret.reset_value = val[4];
+        return ret;
+    }
+    throw std::invalid_argument("invalid preset coding parameters profile: " + s.get_filename());
+}
+} // namespace jlst
@@ -0,0 +1,61 @@
+// Copyright (c) Mathieu Malaterre
+// SPDX-License-Identifier: BSD-3-Clause
+#pragma once
+
+#include "cjpls_options.h"
+
+#include <charls/public_types.h>
+
+#include <cstddef> // for size_t
+#include <cstdint>
+#include <vector>
+
+namespace jlst {
+class image;
+class source;
+class dest;
+
+/**
+ * Encoder parameter search: candidate `jls_options` are trial encoded in
+ * memory, concurrently, and the one giving the smallest codestream wins.
+ * Trials run on a sample of `sample_rows` rows (evenly spaced bands of the
+ * image), or on the whole image when 0.
+ */
+struct search final
+{
+    /**
+     * Index of the candidate giving the smallest codestream for `i`, using
+     * `jobs` threads (0 for one per core). Ties go to the lowest index, so
+     * the reference candidate should come first.
+     */
+    static size_t smallest(const image& i, std::vector<jls_options> const& candidates, uint32_t sample_rows,
+                           int jobs);
+
+    /**
+     * Options of `jo` with the interleave mode and color transformation
+     * minimizing the size of `i`, among the legal combinations: color
+     * transformations need 3 components of 8 or 16 bits and an interleaved
+     * output. A mode or transformation set in `jo` is kept. The input
+     * interleave mode without color transformation comes first.
+     */
+    static jls_options coding_mode(const image& i, const jls_options& jo, uint32_t sample_rows, int jobs);
+
+    /**
+     * Thresholds and reset value minimizing the size of `i` encoded with
+     * `jo`. The default parameters of the bit depth are scaled up and down
+     * together first, then each threshold on its own around the best set.
+     * The maximum sample value of `jo` is kept, the result is never worse
+     * than the default parameters.
+     */
+    static charls::jpegls_pc_parameters preset_coding_parameters(const image& i, const jls_options& jo,
+                                                                 uint32_t sample_rows, int jobs);
+
+    /**
+     * Profile of preset coding parameters: a text file holding the 5 values
+     * in the `--preset_coding_parameters` order, lines starting with '#' are
+     * comments.
+     */
+    static void save_preset_coding_parameters(dest& d, charls::jpegls_pc_parameters const& pcp);
+    static charls::jpegls_pc_parameters load_preset_coding_parameters(source& s);
+};
+} // namespace jlst
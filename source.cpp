@@ -3,13 +3,23 @@
 
 #include "source.h"
 
+#include "stats.h"
+
 #include <stdexcept>
 
-#include <cassert>
+#include <algorithm>
 #include <cstring>
 
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 namespace jlst {
 
+// read granularity from the underlying FILE:
+static const size_t chunk_size = 1 << 16;
+
 source::source() : stream_(stdin)
 {
 }
@@ -24,56 +34,191 @@ source::source(std::string const& filename)
 
 source::~source()
 {
+#ifdef HAVE_MMAP
+    if (mapping_)
+        munmap(mapping_, mapping_size_);
+#endif
     if (!filename_.empty())
         std::fclose(stream_);
 }
 
+void source::fill(size_t n)
+{
+    while (available() < n && !eof_)
+    {
+        const size_t len = buffer_.size();
+        const size_t count = std::max(chunk_size, n - available());
+        buffer_.resize(len + count);
+        stats::scope scope(stats::read);
+        const size_t nr = std::fread(buffer_.data() + len, 1, count, stream_);
+        scope.bytes_in(nr);
+        buffer_.resize(len + nr);
+        if (nr < count)
+            eof_ = true;
+    }
+}
+
+void source::fill_all()
+{
+    while (!eof_)
+    {
+        // grow geometrically:
+        fill(available() + std::max(chunk_size, buffer_.size()));
+    }
+}
+
+bool source::is_regular_file() const
+{
+#ifdef HAVE_MMAP
+    struct stat st;
+    return fstat(fileno(stream_), &st) == 0 && S_ISREG(st.st_mode);
+#else
+    return !filename_.empty();
+#endif
+}
+
 int source::peek()
 {
-    const int c = std::fgetc(stream_);
-    std::ungetc(c, stream_);
+    fill(1);
+    if (available() == 0)
+        return EOF;
+    return buffer_[pos_ - base_];
+}
 
-    return c;
+span<const uint8_t> source::prefix(size_t n)
+{
+    fill(n);
+    return span<const uint8_t>(buffer_.data() + (pos_ - base_), std::min(n, available()));
 }
 
 void source::rewind()
 {
-    std::rewind(stream_);
+    if (base_ == 0)
+    {
+        // start of stream is still buffered:
+        pos_ = 0;
+        return;
+    }
+    if (std::fseek(stream_, 0, SEEK_SET) != 0)
+        throw std::runtime_error("cannot rewind non-seekable stream");
+    buffer_.clear();
+    base_ = 0;
+    pos_ = 0;
+    eof_ = false;
 }
 
 size_t source::read(void* ptr, size_t n)
 {
-    const size_t nr = std::fread(ptr, 1, n, stream_);
-    assert(n == nr);
+    auto out = static_cast<uint8_t*>(ptr);
+    size_t nr = std::min(n, available());
+    std::memcpy(out, buffer_.data() + (pos_ - base_), nr);
+    pos_ += nr;
+    const size_t remaining = n - nr;
+    if (remaining >= chunk_size)
+    {
+        // large read (pixel data): bypass the internal buffer, the buffered
+        // bytes are dropped since they have all been consumed.
+        stats::scope scope(stats::read);
+        const size_t count = std::fread(out + nr, 1, remaining, stream_);
+        scope.bytes_in(count);
+        if (count < remaining)
+            eof_ = true;
+        nr += count;
+        pos_ += count;
+        buffer_.clear();
+        base_ = pos_;
+    }
+    else if (remaining > 0)
+    {
+        fill(remaining);
+        const size_t count = std::min(remaining, available());
+        std::memcpy(out + nr, buffer_.data() + (pos_ - base_), count);
+        nr += count;
+        pos_ += count;
+    }
+    // pixel buffers are not zero-filled, a short read must never go unnoticed:
+    if (nr != n)
+        throw std::runtime_error("truncated input");
     return nr;
 }
 
 std::string source::getline()
 {
-    char line[256];
-    std::fgets(line, sizeof(line), stream_);
-    size_t len = std::strlen(line);
-    if (len > 0 && line[len - 1] == '\n')
+    std::string line;
+    for (;;)
     {
-        line[--len] = '\0';
+        fill(1);
+        const size_t len = available();
+        if (len == 0)
+            break;
+        const uint8_t* first = buffer_.data() + (pos_ - base_);
+        const void* eol = std::memchr(first, '\n', len);
+        if (eol)
+        {
+            const size_t count = static_cast<size_t>(static_cast<const uint8_t*>(eol) - first);
+            line.append(reinterpret_cast<const char*>(first), count);
+            pos_ += count + 1; // skip '\n'
+            break;
+        }
+        line.append(reinterpret_cast<const char*>(first), len);
+        pos_ += len;
     }
     return line;
 }
 
 size_t source::size()
 {
-    std::fseek(stream_, 0, SEEK_END);
-    const size_t byte_count_file = std::ftell(stream_);
-    rewind();
-    return byte_count_file;
+    if (is_regular_file())
+    {
+#ifdef HAVE_MMAP
+        struct stat st;
+        if (fstat(fileno(stream_), &st) == 0)
+            return static_cast<size_t>(st.st_size);
+#else
+        // FILE position must remain right after the last buffered byte:
+        const long cur = std::ftell(stream_);
+        std::fseek(stream_, 0, SEEK_END);
+        const size_t byte_count_file = std::ftell(stream_);
+        std::fseek(stream_, cur, SEEK_SET);
+        return byte_count_file;
+#endif
+    }
+    // size of a pipe is only known once fully read:
+    if (base_ != 0)
+        throw std::runtime_error("cannot compute size of non-seekable stream");
+    fill_all();
+    return buffer_.size();
 }
 
-std::vector<uint8_t> source::read_bytes()
+span<const uint8_t> source::map()
 {
-    assert(std::ftell(stream_) == 0);
-    std::vector<uint8_t> buffer(size());
-    read(buffer.data(), buffer.size());
-    return buffer;
+    if (mapping_)
+        return span<const uint8_t>(static_cast<const uint8_t*>(mapping_), mapping_size_);
+#ifdef HAVE_MMAP
+    // only regular files can be mapped, stdin may also be redirected from one:
+    struct stat st;
+    if (fstat(fileno(stream_), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        const size_t len = static_cast<size_t>(st.st_size);
+        // pages are only read when first accessed, ie by the decoder:
+        stats::scope scope(stats::read, len);
+        void* addr = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fileno(stream_), 0);
+        if (addr != MAP_FAILED)
+        {
+            // the decoder reads the stream once from start to end:
+            madvise(addr, len, MADV_SEQUENTIAL);
+            mapping_ = addr;
+            mapping_size_ = len;
+            return span<const uint8_t>(static_cast<const uint8_t*>(mapping_), mapping_size_);
+        }
+    }
+#endif
+    // fallback: size of stream is not known in advance (pipes), keep
+    // whatever was already buffered (header) and read the rest in chunks:
+    if (base_ != 0)
+        rewind();
+    fill_all();
+    return span<const uint8_t>(buffer_.data(), buffer_.size());
 }
 
 } // end namespace jlst
@@ -2,12 +2,20 @@
 // SPDX-License-Identifier: BSD-3-Clause
 #pragma once
 
+#include "allocator.h"
+#include "span.h"
+
 #include <cstdint>
 #include <cstdio>
 #include <string>
-#include <vector>
 
 namespace jlst {
+/**
+ * Input stream with an internal growable buffer. Bytes are read from the
+ * underlying FILE in large chunks; header parsing (peek, getline, small
+ * reads) and `rewind` operate on already buffered bytes, so that a
+ * non-seekable stream (stdin, pipes) can be processed in a single pass.
+ */
 class source
 {
 public:
@@ -16,7 +24,13 @@ public:
     ~source();
 
     int peek();
+    /**
+     * Returns a view of (at most) the next `n` bytes without consuming them.
+     * The view is invalidated by the next read operation.
+     */
+    span<const uint8_t> prefix(size_t n);
     void rewind();
+    // reads exactly `n` bytes, throws on a truncated stream
     size_t read(void* ptr, size_t n);
     std::string getline();
     size_t size();
@@ -25,14 +39,27 @@ public:
     {
         return filename_;
     }
-    std::vector<uint8_t> read_bytes();
+    /**
+     * Returns a read-only view of the whole stream. Regular files are
+     * memory-mapped (no copy), other streams (stdin, pipes) are read into an
+     * internal buffer. The view remains valid for the lifetime of the source.
+     */
+    span<const uint8_t> map();
 
     source(source&& s)
     {
         stream_ = s.stream_;
         filename_ = s.filename_;
+        mapping_ = s.mapping_;
+        mapping_size_ = s.mapping_size_;
+        buffer_.swap(s.buffer_);
+        base_ = s.base_;
+        pos_ = s.pos_;
+        eof_ = s.eof_;
         s.stream_ = nullptr;
         s.filename_ = "";
+        s.mapping_ = nullptr;
+        s.mapping_size_ = 0;
     }
 
 private:
@@ -40,8 +67,24 @@ private:
     source& operator=(const source& s); // Assignment operator
     source& operator=(source&& s);      // move assignement
 
+    size_t available() const
+    {
+        return base_ + buffer_.size() - pos_;
+    }
+    void fill(size_t n);
+    void fill_all();
+    bool is_regular_file() const;
+
     FILE* stream_;
     std::string filename_;
+    void* mapping_{};
+    size_t mapping_size_{};
+    // buffer_ holds bytes [base_, base_ + buffer_.size()) of the stream, the
+    // FILE position is always right after the last buffered byte:
+    byte_buffer buffer_{};
+    size_t base_{};
+    size_t pos_{};
+    bool eof_{};
 };
 
 } // namespace jlst
@@ -0,0 +1,57 @@
+// Copyright (c) Mathieu Malaterre
+// SPDX-License-Identifier: BSD-3-Clause
+#pragma once
+
+#include <cstddef> // for size_t
+
+namespace jlst {
+// Minimal non-owning view over contiguous memory (std::span is c++20).
+// Exposes `value_type`, `data()` and `size()` so that it can be handed
+// directly to charls::jpegls_decoder::source()
+template<typename T>
+class span
+{
+public:
+    typedef T value_type;
+
+    span() noexcept : data_(nullptr), size_(0)
+    {
+    }
+    span(T* data, std::size_t size) noexcept : data_(data), size_(size)
+    {
+    }
+
+    T* data() const noexcept
+    {
+        return data_;
+    }
+    std::size_t size() const noexcept
+    {
+        return size_;
+    }
+    bool empty() const noexcept
+    {
+        return size_ == 0;
+    }
+    T& operator[](std::size_t index) const noexcept
+    {
+        return data_[index];
+    }
+    T* begin() const noexcept
+    {
+        return data_;
+    }
+    T* end() const noexcept
+    {
+        return data_ + size_;
+    }
+    span subspan(std::size_t offset, std::size_t count) const noexcept
+    {
+        return span(data_ + offset, count);
+    }
+
+private:
+    T* data_;
+    std::size_t size_;
+};
+} // namespace jlst
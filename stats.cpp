@@ -0,0 +1,197 @@
+// Copyright (c) Mathieu Malaterre
+// SPDX-License-Identifier: BSD-3-Clause
+#include "stats.h"
+
+#include "dest.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+
+#ifdef HAVE_GETRUSAGE
+#include <sys/resource.h>
+#endif
+
+namespace jlst {
+bool stats::enabled_ = false;
+
+namespace {
+const char* const phase_names[] = {"read", "detect", "header", "decode", "encode", "transform", "hash", "write"};
+
+struct totals
+{
+    uint64_t calls{};
+    double wall{};
+    double cpu{};
+    uint64_t bytes_in{};
+    uint64_t bytes_out{};
+    long peak_rss_kb{};
+};
+
+struct state
+{
+    std::mutex mutex;
+    totals phases[stats::phase_count];
+    std::string filename;
+    double wall_start{};
+    double cpu_start{};
+};
+
+state& get_state()
+{
+    static state s;
+    return s;
+}
+
+double wall_time()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// CPU time of the calling thread, phases may run concurrently
+double thread_cpu_time()
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+        return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) * 1e-9;
+#endif
+    return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+}
+
+// CPU time of all threads, user + system
+double process_cpu_time()
+{
+#ifdef HAVE_GETRUSAGE
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+               static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+#endif
+    return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+}
+
+// peak resident set size so far, 0 when unknown
+long peak_rss_kb()
+{
+#ifdef HAVE_GETRUSAGE
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        return usage.ru_maxrss;
+#endif
+    return 0;
+}
+
+// throughput of the phase, on its input or else on its output
+double mb_per_s(totals const& t)
+{
+    const uint64_t bytes = t.bytes_in ? t.bytes_in : t.bytes_out;
+    return t.wall > 0 ? static_cast<double>(bytes) / t.wall / 1e6 : 0;
+}
+} // namespace
+
+void stats::enable(std::string const& filename)
+{
+    auto& s = get_state();
+    s.filename = filename;
+    s.wall_start = wall_time();
+    s.cpu_start = process_cpu_time();
+    enabled_ = true;
+}
+
+void stats::scope::start()
+{
+    wall_ = wall_time();
+    cpu_ = thread_cpu_time();
+}
+
+void stats::scope::stop()
+{
+    const double wall = wall_time() - wall_;
+    const double cpu = thread_cpu_time() - cpu_;
+    const long rss = peak_rss_kb();
+    auto& s = get_state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto& t = s.phases[phase_];
+    ++t.calls;
+    t.wall += wall;
+    t.cpu += cpu;
+    t.bytes_in += bytes_in_;
+    t.bytes_out += bytes_out_;
+    t.peak_rss_kb = std::max(t.peak_rss_kb, rss);
+}
+
+void stats::report()
+{
+    if (!enabled_)
+        return;
+    auto& s = get_state();
+    totals phases[phase_count];
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        std::copy(s.phases, s.phases + phase_count, phases);
+    }
+    const double wall = wall_time() - s.wall_start;
+    const double cpu = process_cpu_time() - s.cpu_start;
+    const long rss = peak_rss_kb();
+
+    std::ostringstream os;
+    os << std::fixed;
+    if (s.filename.empty())
+    {
+        os << std::left << std::setw(10) << "phase" << std::right << ' ' << std::setw(8) << "calls" << ' '
+           << std::setw(10) << "wall(s)" << ' ' << std::setw(10) << "cpu(s)" << ' ' << std::setw(12) << "in(MB)" << ' '
+           << std::setw(12) << "out(MB)" << ' ' << std::setw(10) << "MB/s" << ' ' << std::setw(14) << "peak RSS(MB)"
+           << '\n';
+        for (int p = 0; p < phase_count; ++p)
+        {
+            auto& t = phases[p];
+            if (t.calls == 0)
+                continue;
+            os << std::left << std::setw(10) << phase_names[p] << std::right << ' ' << std::setw(8) << t.calls << ' '
+               << std::setprecision(3) << std::setw(10) << t.wall << ' ' << std::setw(10) << t.cpu << ' '
+               << std::setw(12) << static_cast<double>(t.bytes_in) / 1e6 << ' ' << std::setw(12)
+               << static_cast<double>(t.bytes_out) / 1e6 << ' ' << std::setprecision(1) << std::setw(10) << mb_per_s(t)
+               << ' ' << std::setw(14) << static_cast<double>(t.peak_rss_kb) / 1024 << '\n';
+        }
+        os << std::left << std::setw(10) << "total" << std::right << ' ' << std::setw(8) << "" << ' '
+           << std::setprecision(3) << std::setw(10) << wall << ' ' << std::setw(10) << cpu << ' ' << std::setw(12) << ""
+           << ' ' << std::setw(12) << "" << ' ' << std::setw(10) << "" << ' ' << std::setprecision(1) << std::setw(14)
+           << static_cast<double>(rss) / 1024 << '\n';
+        std::cerr << os.str();
+        return;
+    }
+
+    os << "{\"phases\":{";
+    bool first = true;
+    for (int p = 0; p < phase_count; ++p)
+    {
+        auto& t = phases[p];
+        if (t.calls == 0)
+            continue;
+        os << (first ? "" : ",") << '"' << phase_names[p] << "\":{\"calls\":" << t.calls << std::setprecision(6)
+           << ",\"wall_s\":" << t.wall << ",\"cpu_s\":" << t.cpu << ",\"bytes_in\":" << t.bytes_in
+           << ",\"bytes_out\":" << t.bytes_out << std::setprecision(1) << ",\"mb_per_s\":" << mb_per_s(t)
+           << ",\"peak_rss_kb\":" << t.peak_rss_kb << '}';
+        first = false;
+    }
+    os << "},\"total\":{\"wall_s\":" << std::setprecision(6) << wall << ",\"cpu_s\":" << cpu
+       << ",\"peak_rss_kb\":" << rss << "}}\n";
+    const std::string str = os.str();
+    // called on the error paths too, never throws:
+    try
+    {
+        dest d(s.filename);
+        d.write(str.data(), str.size());
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << "Error writing statistics: " << e.what() << std::endl;
+    }
+}
+} // namespace jlst
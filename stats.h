@@ -0,0 +1,80 @@
+// Copyright (c) Mathieu Malaterre
+// SPDX-License-Identifier: BSD-3-Clause
+#pragma once
+
+#include <cstddef> // for size_t
+#include <string>
+
+namespace jlst {
+/**
+ * Per-phase statistics (`--stats`): number of calls, wall and CPU time,
+ * bytes in and out, and the peak resident set size at the end of the phase.
+ * Phases are timed by `stats::scope`, which only tests a flag unless the
+ * statistics were enabled. Phases running concurrently (batch mode, stripes)
+ * add up their times, which can then exceed the elapsed time.
+ */
+struct stats final
+{
+    enum phase
+    {
+        read,
+        detect,
+        header,
+        decode,
+        encode,
+        transform,
+        hash,
+        write,
+        phase_count
+    };
+
+    // before any phase is timed: the report goes to `filename` as JSON, or to stderr as a table when empty
+    static void enable(std::string const& filename);
+    static bool enabled()
+    {
+        return enabled_;
+    }
+    // prints the report, if enabled. Errors are reported on stderr
+    static void report();
+
+    class scope
+    {
+    public:
+        explicit scope(phase p, size_t bytes_in = 0, size_t bytes_out = 0)
+            : phase_(p), bytes_in_(bytes_in), bytes_out_(bytes_out)
+        {
+            if (enabled_)
+                start();
+        }
+        ~scope()
+        {
+            if (enabled_)
+                stop();
+        }
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+
+        // when only known at the end of the phase
+        void bytes_in(size_t n)
+        {
+            bytes_in_ = n;
+        }
+        void bytes_out(size_t n)
+        {
+            bytes_out_ = n;
+        }
+
+    private:
+        void start();
+        void stop();
+        phase phase_;
+        size_t bytes_in_;
+        size_t bytes_out_;
+        double wall_{};
+        double cpu_{};
+    };
+
+private:
+    static bool enabled_;
+};
+} // namespace jlst
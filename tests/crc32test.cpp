@@ -0,0 +1,80 @@
+// Copyright (c) Mathieu Malaterre
+// SPDX-License-Identifier: BSD-3-Clause
+#include "crc32.h" // for crc32
+#include <cstdint> // for uint32_t
+#include <cstdlib> // for EXIT_FAILURE, EXIT_SUCCESS
+#include <iostream>
+#include <vector>
+
+/**
+ * CRC-32 regression test: the checksums of a fixed pseudo-random buffer
+ * (values from zlib), for sizes around the slicing-by-8 tail, the 16/64 bytes
+ * blocks of the PCLMUL folding and the 4 MiB chunks of the threaded checksum,
+ * from an aligned and an unaligned start, in one call, threaded, and in two
+ * updates or two combined halves.
+ */
+
+namespace {
+struct expected
+{
+    size_t size;
+    uint32_t crc;           // of data[0, size)
+    uint32_t crc_unaligned; // of data[1, size + 1)
+};
+
+const expected expected_values[] = {
+    {0, 0x00000000, 0x00000000},        {1, 0x06b9df6f, 0x62d277af},        {7, 0x294edd59, 0x3edea35e},
+    {8, 0x98f40411, 0x5bef1ace},        {9, 0xbd2a6c68, 0xf1806728},        {15, 0x75d4cef8, 0xa748b38a},
+    {16, 0x8ca9c24d, 0xafa2398f},       {17, 0xaa898fed, 0x5c13a24d},       {63, 0xe533b871, 0x2161f33b},
+    {64, 0x05ea0edb, 0xb0fe93a1},       {65, 0x10d0fa24, 0x57d721c6},       {79, 0x854d6351, 0x1e051e98},
+    {127, 0x3503daa8, 0x40893b7a},      {128, 0x26e35906, 0x10959911},      {129, 0x4940ce64, 0x93160074},
+    {1000, 0xe08314a4, 0x33c68c49},     {4194303, 0xf0c6250f, 0x9e37537a},  {4194304, 0x22fdbaec, 0x6efa5bc4},
+    {8388611, 0x2fa5d1c4, 0x5ca75f23},  {12582929, 0x19df62a1, 0x9376fdbc},
+};
+
+bool check(const char* what, size_t size, uint32_t actual, uint32_t expected)
+{
+    if (actual == expected)
+        return true;
+    std::cerr << what << " size " << size << ": " << std::hex << actual << " instead of " << expected << std::dec
+              << std::endl;
+    return false;
+}
+} // namespace
+
+int main()
+{
+    bool success = true;
+    const char check_string[] = "123456789";
+    jlst::byte_buffer check_buffer(check_string, check_string + 9);
+    if (jlst::crc32::compute(check_buffer) != "cbf43926")
+    {
+        std::cerr << "check value: " << jlst::crc32::compute(check_buffer) << std::endl;
+        success = false;
+    }
+
+    std::vector<uint8_t> data(expected_values[sizeof(expected_values) / sizeof(expected_values[0]) - 1].size + 1);
+    uint32_t state = 2463534242u; // xorshift32
+    for (auto& byte : data)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        byte = static_cast<uint8_t>(state);
+    }
+
+    for (auto& e : expected_values)
+    {
+        const uint8_t* p = data.data();
+        success = check("checksum", e.size, jlst::crc32::checksum(p, e.size), e.crc) && success;
+        success = check("unaligned", e.size, jlst::crc32::checksum(p + 1, e.size), e.crc_unaligned) && success;
+        // more threads than cores is fine, every 4 MiB chunk gets its own job:
+        success = check("threaded", e.size, jlst::crc32::checksum(p, e.size, 4), e.crc) && success;
+        const size_t half = e.size / 2 + 3 < e.size ? e.size / 2 + 3 : e.size;
+        const uint32_t head = jlst::crc32::update(0, p, half);
+        const uint32_t tail = jlst::crc32::update(0, p + half, e.size - half);
+        success = check("update", e.size, jlst::crc32::update(head, p + half, e.size - half), e.crc) && success;
+        success = check("combine", e.size, jlst::crc32::combine(head, tail, e.size - half), e.crc) && success;
+    }
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,266 @@
+// Copyright (c) Mathieu Malaterre
+// SPDX-License-Identifier: BSD-3-Clause
+#include "cpu.h"   // for JLST_X86_DISPATCH
+#include "dest.h"  // for dest
+#include "image.h" // for image
+#include "utils.h" // for utils
+#include <boost/program_options.hpp>
+#include <algorithm> // for sort, find, max, min
+#include <chrono>    // for steady_clock
+#include <cstdint>   // for uint64_t
+#include <cstdlib>   // for EXIT_FAILURE, EXIT_SUCCESS
+#include <iomanip>   // for setprecision
+#include <iostream>  // for cout, cerr
+#include <sstream>   // for ostringstream
+#include <string>    // for string
+#include <vector>    // for vector
+#ifdef JLST_X86_DISPATCH
+#include <x86intrin.h> // for __rdtsc
+#endif
+
+/**
+ * Microbenchmark of the pixel kernels of image.cpp and utils.cpp, on synthetic
+ * images of every requested size (square, from cache resident to DRAM bound),
+ * bit depth and component count. Components are interleaved by sample, except
+ * for the input of planar_to_triplet.
+ *
+ * Each configuration is run once untimed, then timed at least `iterations`
+ * times (more for the small images, so that each configuration processes at
+ * least 64 MB). The report is a JSON object with one record per line: the
+ * median throughput in GB/s and, on x86, in bytes per cycle of the time stamp
+ * counter (reference cycles, not core cycles under frequency scaling).
+ */
+
+namespace {
+struct kernel
+{
+    const char* name;
+    bool color_only;
+    // when the kernel changes the image size, the image is restored (untimed) before each run
+    bool restore;
+    void (*run)(jlst::image& img, jlst::byte_buffer& buffer, int jobs);
+};
+
+const kernel kernels[] = {
+    {"crop", false, true,
+     [](jlst::image& img, jlst::byte_buffer&, int jobs) {
+         auto& frame_info = img.get_image_info().frame_info();
+         img.crop(1, 1, frame_info.width - 2, frame_info.height - 2, jobs);
+     }},
+    {"flip_horizontal", false, false, [](jlst::image& img, jlst::byte_buffer&, int jobs) { img.flip(false, jobs); }},
+    {"flip_vertical", false, false, [](jlst::image& img, jlst::byte_buffer&, int jobs) { img.flip(true, jobs); }},
+    {"rotate90", false, false, [](jlst::image& img, jlst::byte_buffer&, int jobs) { img.rotate(90, jobs); }},
+    {"rotate180", false, false, [](jlst::image& img, jlst::byte_buffer&, int jobs) { img.rotate(180, jobs); }},
+    {"rotate270", false, false, [](jlst::image& img, jlst::byte_buffer&, int jobs) { img.rotate(270, jobs); }},
+    {"transpose", false, false, [](jlst::image& img, jlst::byte_buffer&, int jobs) { img.transpose(jobs); }},
+    {"transverse", false, false, [](jlst::image& img, jlst::byte_buffer&, int jobs) { img.transverse(jobs); }},
+    {"wipe", false, false,
+     [](jlst::image& img, jlst::byte_buffer&, int jobs) {
+         auto& frame_info = img.get_image_info().frame_info();
+         img.wipe(1, 1, frame_info.width - 2, frame_info.height - 2, jobs);
+     }},
+    {"transform", true, false,
+     [](jlst::image& img, jlst::byte_buffer& buffer, int) {
+         img.transform(charls::interleave_mode::none, buffer);
+     }},
+    {"triplet_to_planar", true, false,
+     [](jlst::image& img, jlst::byte_buffer& buffer, int) {
+         auto& frame_info = img.get_image_info().frame_info();
+         jlst::utils::triplet_to_planar(img.get_image_data().pixel_data().data(), buffer.data(), frame_info.width,
+                                        frame_info.height, static_cast<uint8_t>(frame_info.bits_per_sample), 0);
+     }},
+    {"planar_to_triplet", true, false,
+     [](jlst::image& img, jlst::byte_buffer& buffer, int) {
+         auto& frame_info = img.get_image_info().frame_info();
+         jlst::utils::planar_to_triplet(img.get_image_data().pixel_data().data(), buffer.data(), frame_info.width,
+                                        frame_info.height, static_cast<uint8_t>(frame_info.bits_per_sample), 0);
+     }},
+};
+
+uint64_t cycles()
+{
+#ifdef JLST_X86_DISPATCH
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// noise, so that no kernel sees a constant image
+jlst::image synthetic_image(uint32_t side, int bits_per_sample, int component_count, bool planar)
+{
+    jlst::image ret;
+    auto& frame_info = ret.get_image_info().frame_info();
+    frame_info.width = side;
+    frame_info.height = side;
+    frame_info.bits_per_sample = bits_per_sample;
+    frame_info.component_count = component_count;
+    ret.get_image_info().interleave_mode() =
+        component_count == 1 || planar ? charls::interleave_mode::none : charls::interleave_mode::sample;
+    auto& pixel_data = ret.get_image_data().pixel_data();
+    pixel_data.resize(static_cast<size_t>(side) * side * static_cast<size_t>(component_count) *
+                      static_cast<size_t>((bits_per_sample + 7) / 8));
+    uint32_t state = 2463534242u; // xorshift32
+    for (auto& byte : pixel_data)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        byte = static_cast<uint8_t>(state);
+    }
+    return ret;
+}
+
+void bench(std::ostream& os, kernel const& k, uint32_t side, int bits_per_sample, int component_count, int iterations,
+           int jobs)
+{
+    typedef std::chrono::steady_clock clock;
+    const bool planar = std::string(k.name) == "planar_to_triplet";
+    const jlst::image reference = synthetic_image(side, bits_per_sample, component_count, planar);
+    const size_t bytes = reference.get_image_data().pixel_data().size();
+    jlst::image img = reference;
+    jlst::byte_buffer buffer(bytes);
+
+    // the small images are run more often, for a stable median:
+    const size_t min_bytes = size_t{64} << 20;
+    const size_t runs = std::max(static_cast<size_t>(iterations), std::min(min_bytes / bytes, size_t{100000}));
+    std::vector<double> seconds;
+    std::vector<uint64_t> ticks;
+    for (size_t run = 0; run <= runs; ++run)
+    {
+        if (k.restore)
+            img = reference;
+        const auto start = clock::now();
+        const uint64_t start_cycles = cycles();
+        k.run(img, buffer, jobs);
+        const uint64_t stop_cycles = cycles();
+        const auto stop = clock::now();
+        if (run == 0)
+            continue; // warm-up
+        seconds.push_back(std::chrono::duration<double>(stop - start).count());
+        ticks.push_back(stop_cycles - start_cycles);
+    }
+    std::sort(seconds.begin(), seconds.end());
+    std::sort(ticks.begin(), ticks.end());
+    const double median = std::max(seconds[seconds.size() / 2], 1e-9);
+    const uint64_t median_ticks = ticks[ticks.size() / 2];
+
+    os << "{\"kernel\":\"" << k.name << "\",\"width\":" << side << ",\"height\":" << side
+       << ",\"bits_per_sample\":" << bits_per_sample << ",\"component_count\":" << component_count
+       << ",\"bytes\":" << bytes << ",\"runs\":" << runs << std::fixed << std::setprecision(3)
+       << ",\"gb_per_s\":" << static_cast<double>(bytes) / median / 1e9 << ",\"bytes_per_cycle\":";
+    if (median_ticks)
+        os << static_cast<double>(bytes) / static_cast<double>(median_ticks);
+    else
+        os << "null";
+    os << ",\"p50_us\":" << median * 1e6 << '}';
+    os.unsetf(std::ios::floatfield);
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    int iterations{10};
+    int jobs{1};
+    std::vector<uint32_t> sides{};
+    std::vector<int> bits_per_sample{};
+    std::vector<int> component_count{};
+    std::vector<std::string> names{};
+    std::string output{};
+    try
+    {
+        namespace po = boost::program_options;
+        po::options_description desc("Allowed options");
+        desc.add_options()("help,h", "print usage message") // help
+            ("iterations,N", po::value(&iterations),
+             "Minimum timed runs per configuration (default 10).") // iterations
+            ("size,s", po::value(&sides)->multitoken(),
+             "Sides of the square images (default 64 256 1024 4096).") // size
+            ("bits_per_sample,b", po::value(&bits_per_sample)->multitoken(),
+             "Bits per sample values (default 8 12 16).") // bits per sample
+            ("component_count,c", po::value(&component_count)->multitoken(),
+             "Component count values (default 1 3).") // component count
+            ("kernel,k", po::value(&names)->multitoken(), "Kernels to measure (default all).") // kernels
+            ("jobs,j", po::value(&jobs), "Number of worker threads, 0 for one per core (default 1).") // jobs
+            ("output,o", po::value(&output), "Output filename (JSON report), default stdout.")        // output
+            ;
+        po::variables_map vm;
+        po::store(po::command_line_parser(argc, argv).options(desc).run(), vm);
+        if (vm.count("help"))
+        {
+            std::cout << "usage: kernelbench [options]\n";
+            std::cout << desc << std::endl;
+            return EXIT_SUCCESS;
+        }
+        po::notify(vm);
+
+        if (iterations < 1)
+            throw std::invalid_argument("iterations: " + std::to_string(iterations));
+        if (sides.empty())
+            sides = {64, 256, 1024, 4096};
+        for (uint32_t side : sides)
+        {
+            // the crop and wipe regions leave a 1 pixel border:
+            if (side < 3)
+                throw std::invalid_argument("size: " + std::to_string(side));
+        }
+        if (bits_per_sample.empty())
+            bits_per_sample = {8, 12, 16};
+        for (int bits : bits_per_sample)
+        {
+            if (bits < 2 || bits > 16)
+                throw std::invalid_argument("bits_per_sample: " + std::to_string(bits));
+        }
+        if (component_count.empty())
+            component_count = {1, 3};
+        for (int count : component_count)
+        {
+            if (count < 1 || count > 255)
+                throw std::invalid_argument("component_count: " + std::to_string(count));
+        }
+        for (auto& name : names)
+        {
+            if (std::find_if(std::begin(kernels), std::end(kernels),
+                             [&name](kernel const& k) { return name == k.name; }) == std::end(kernels))
+                throw std::invalid_argument("kernel: " + name);
+        }
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << "Invalid options: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        std::ostringstream os;
+        os << "{\n  \"jobs\": " << jobs << ",\n  \"results\": [\n";
+        bool first = true;
+        for (auto& k : kernels)
+        {
+            if (!names.empty() && std::find(names.begin(), names.end(), k.name) == names.end())
+                continue;
+            for (uint32_t side : sides)
+                for (int bits : bits_per_sample)
+                    for (int count : component_count)
+                    {
+                        if (k.color_only && count != 3)
+                            continue;
+                        os << (first ? "" : ",\n") << "    ";
+                        bench(os, k, side, bits, count, iterations, jobs);
+                        first = false;
+                    }
+        }
+        os << "\n  ]\n}\n";
+        const std::string str = os.str();
+        jlst::dest dest = output.empty() ? jlst::dest() : jlst::dest(output);
+        dest.write(str.data(), str.size());
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << "Error during benchmark: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -2,101 +2,327 @@
 // SPDX-License-Identifier: BSD-3-Clause
 #include "utils.h"
 
-#include <cstring>   // std::memcpy
+#include "cpu.h"
+#include "dest.h"
+
+#include <algorithm> // std::min
 #include <stdexcept> // std::invalid_argument
 
+#ifdef JLST_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
 namespace jlst {
+namespace {
+// Each row is converted in blocks of 16 bytes per plane (48 bytes of
+// triplets), the remaining pixels are converted by the scalar loops.
+struct shuffle_masks
+{
+    // pshufb masks, 0x80 clears the byte:
+    //   split[c][v]: bytes of plane c coming from the v-th 16 bytes of triplets
+    //   merge[v][c]: bytes of the v-th 16 bytes of triplets coming from plane c
+    uint8_t split[3][3][16];
+    uint8_t merge[3][3][16];
+
+    explicit shuffle_masks(size_t nbytes)
+    {
+        for (size_t c = 0; c < 3; ++c)
+            for (size_t v = 0; v < 3; ++v)
+                for (size_t j = 0; j < 16; ++j)
+                {
+                    const size_t src = (j / nbytes * 3 + c) * nbytes + j % nbytes;
+                    split[c][v][j] = static_cast<uint8_t>(src / 16 == v ? src % 16 : 0x80);
+                    const size_t pos = v * 16 + j;
+                    const size_t channel = pos / nbytes % 3;
+                    merge[v][c][j] =
+                        static_cast<uint8_t>(channel == c ? pos / (3 * nbytes) * nbytes + pos % nbytes : 0x80);
+                }
+    }
+};
 
-template<typename T>
-static std::vector<T> triplet_to_planar_impl(const std::vector<T>& buffer, const size_t width, const size_t height,
-                                             const size_t stride)
+const shuffle_masks& get_masks(size_t nbytes)
 {
-    constexpr size_t bytes_per_rgb_pixel{3};
-    std::vector<T> result(bytes_per_rgb_pixel * width * height);
-    const size_t byte_count_plane{width * height};
+    static const shuffle_masks masks8(1);
+    static const shuffle_masks masks16(2);
+    return nbytes == 1 ? masks8 : masks16;
+}
 
-    size_t plane_column{};
-    for (size_t line{}; line != height; ++line)
+// `count` is the number of bytes of a plane row
+template<size_t N>
+void split_row(const uint8_t* in, uint8_t* const* out, size_t count)
+{
+    // local pointers, stores through uint8_t* could alias `out`:
+    uint8_t* p0 = out[0];
+    uint8_t* p1 = out[1];
+    uint8_t* p2 = out[2];
+    for (size_t i = 0; i < count; i += N, in += 3 * N)
+        for (size_t b = 0; b < N; ++b)
+        {
+            p0[i + b] = in[b];
+            p1[i + b] = in[N + b];
+            p2[i + b] = in[2 * N + b];
+        }
+}
+
+template<size_t N>
+void merge_row(const uint8_t* const* in, uint8_t* out, size_t count)
+{
+    const uint8_t* p0 = in[0];
+    const uint8_t* p1 = in[1];
+    const uint8_t* p2 = in[2];
+    for (size_t i = 0; i < count; i += N, out += 3 * N)
+        for (size_t b = 0; b < N; ++b)
+        {
+            out[b] = p0[i + b];
+            out[N + b] = p1[i + b];
+            out[2 * N + b] = p2[i + b];
+        }
+}
+
+#ifdef JLST_X86_DISPATCH
+// SIMD kernels convert whole blocks of a row and return the number of bytes
+// per plane converted
+__attribute__((target("ssse3"))) size_t split_ssse3(const uint8_t* in, uint8_t* const* out, size_t count,
+                                                    const shuffle_masks& masks)
+{
+    __m128i m[3][3];
+    for (size_t c = 0; c < 3; ++c)
+        for (size_t v = 0; v < 3; ++v)
+            m[c][v] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(masks.split[c][v]));
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16, in += 48)
     {
-        const auto line_start{line * stride};
-        for (size_t pixel{}; pixel != width; ++pixel)
+        const __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+        const __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 16));
+        const __m128i v2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 32));
+        for (size_t c = 0; c < 3; ++c)
         {
-            const auto column{line_start + pixel * bytes_per_rgb_pixel};
-            result[plane_column + 0 * byte_count_plane] = buffer[column + 0];
-            result[plane_column + 1 * byte_count_plane] = buffer[column + 1];
-            result[plane_column + 2 * byte_count_plane] = buffer[column + 2];
-            ++plane_column;
+            const __m128i p = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v0, m[c][0]), _mm_shuffle_epi8(v1, m[c][1])),
+                                           _mm_shuffle_epi8(v2, m[c][2]));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out[c] + i), p);
         }
     }
+    return i;
+}
 
-    return result;
+__attribute__((target("ssse3"))) size_t merge_ssse3(const uint8_t* const* in, uint8_t* out, size_t count,
+                                                    const shuffle_masks& masks)
+{
+    __m128i m[3][3];
+    for (size_t v = 0; v < 3; ++v)
+        for (size_t c = 0; c < 3; ++c)
+            m[v][c] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(masks.merge[v][c]));
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16, out += 48)
+    {
+        const __m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in[0] + i));
+        const __m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in[1] + i));
+        const __m128i p2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in[2] + i));
+        for (size_t v = 0; v < 3; ++v)
+        {
+            const __m128i t = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(p0, m[v][0]), _mm_shuffle_epi8(p1, m[v][1])),
+                                           _mm_shuffle_epi8(p2, m[v][2]));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16 * v), t);
+        }
+    }
+    return i;
 }
 
-template<typename T>
-static std::vector<T> planar_to_triplet_impl(const std::vector<T>& buffer, const size_t width, const size_t height,
-                                             const size_t stride)
+// AVX2 shuffles within 128 bits lanes: the low lane converts a block of 16
+// bytes per plane, the high lane the next one, with the SSSE3 masks.
+__attribute__((target("avx2"))) size_t split_avx2(const uint8_t* in, uint8_t* const* out, size_t count,
+                                                  const shuffle_masks& masks)
 {
-    constexpr size_t bytes_per_rgb_pixel{3};
-    std::vector<T> result(bytes_per_rgb_pixel * width * height);
-    const size_t byte_count_plane{width * height};
+    __m256i m[3][3];
+    for (size_t c = 0; c < 3; ++c)
+        for (size_t v = 0; v < 3; ++v)
+            m[c][v] = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(masks.split[c][v])));
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32, in += 96)
+    {
+        __m256i v[3];
+        for (size_t k = 0; k < 3; ++k)
+            v[k] = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 16 * k))),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 48 + 16 * k)), 1);
+        for (size_t c = 0; c < 3; ++c)
+        {
+            const __m256i p =
+                _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(v[0], m[c][0]), _mm256_shuffle_epi8(v[1], m[c][1])),
+                                _mm256_shuffle_epi8(v[2], m[c][2]));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out[c] + i), p);
+        }
+    }
+    return i;
+}
 
-    size_t plane_column{};
-    for (size_t line{}; line != height; ++line)
+__attribute__((target("avx2"))) size_t merge_avx2(const uint8_t* const* in, uint8_t* out, size_t count,
+                                                  const shuffle_masks& masks)
+{
+    __m256i m[3][3];
+    for (size_t v = 0; v < 3; ++v)
+        for (size_t c = 0; c < 3; ++c)
+            m[v][c] = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(masks.merge[v][c])));
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32, out += 96)
     {
-        const auto line_start{line * stride};
-        for (size_t pixel{}; pixel != width; ++pixel)
+        const __m256i p0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in[0] + i));
+        const __m256i p1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in[1] + i));
+        const __m256i p2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in[2] + i));
+        for (size_t v = 0; v < 3; ++v)
         {
-            const auto column{line_start + pixel * bytes_per_rgb_pixel};
-            result[column + 0] = buffer[plane_column + 0 * byte_count_plane];
-            result[column + 1] = buffer[plane_column + 1 * byte_count_plane];
-            result[column + 2] = buffer[plane_column + 2 * byte_count_plane];
-            ++plane_column;
+            const __m256i t =
+                _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(p0, m[v][0]), _mm256_shuffle_epi8(p1, m[v][1])),
+                                _mm256_shuffle_epi8(p2, m[v][2]));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16 * v), _mm256_castsi256_si128(t));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 48 + 16 * v), _mm256_extracti128_si256(t, 1));
         }
     }
+    return i;
+}
 
-    return result;
+__attribute__((target("ssse3"))) size_t byteswap16_ssse3(const uint8_t* in, uint8_t* out, size_t size)
+{
+    const __m128i m = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_shuffle_epi8(v, m));
+    }
+    return i;
+}
+
+__attribute__((target("avx2"))) size_t byteswap16_avx2(const uint8_t* in, uint8_t* out, size_t size)
+{
+    const __m256i m = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14, //
+                                       1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64)
+    {
+        const __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        const __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i + 32));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_shuffle_epi8(v0, m));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i + 32), _mm256_shuffle_epi8(v1, m));
+    }
+    return i;
+}
+#endif
+
+size_t get_nbytes(const uint8_t bits_per_sample, const char* what)
+{
+    if (bits_per_sample == 0 || bits_per_sample > 16)
+        throw std::invalid_argument(what);
+    return bits_per_sample <= 8 ? 1 : 2;
 }
+} // namespace
 
-std::vector<uint8_t> utils::triplet_to_planar(const std::vector<uint8_t>& buffer, const size_t width, const size_t height,
-                                              const uint8_t bits_per_sample, const size_t stride)
+void utils::triplet_to_planar(const uint8_t* in, uint8_t* out, const size_t width, const size_t height,
+                              const uint8_t bits_per_sample, const size_t stride)
 {
-    if (bits_per_sample <= 8)
+    const size_t nbytes = get_nbytes(bits_per_sample, "triplet_to_planar");
+    const size_t row_size = width * nbytes;
+    const size_t plane_size = row_size * height;
+    const auto& masks = get_masks(nbytes);
+    using kernel = size_t (*)(const uint8_t*, uint8_t* const*, size_t, const shuffle_masks&);
+    kernel simd = nullptr;
+#ifdef JLST_X86_DISPATCH
+    simd = cpu::has_avx2() ? split_avx2 : cpu::has_ssse3() ? split_ssse3 : nullptr;
+#endif
+    // contiguous rows are converted as a single row:
+    const bool contiguous = stride == 0 || stride == 3 * row_size;
+    const size_t rows = contiguous ? 1 : height;
+    const size_t count = contiguous ? plane_size : row_size;
+    for (size_t line = 0; line != rows; ++line)
     {
-        return triplet_to_planar_impl(buffer, width, height, stride);
+        const uint8_t* src = in + line * stride;
+        uint8_t* const dst[3] = {out + line * row_size, out + plane_size + line * row_size,
+                                 out + 2 * plane_size + line * row_size};
+        const size_t done = simd ? simd(src, dst, count, masks) : 0;
+        uint8_t* const tail[3] = {dst[0] + done, dst[1] + done, dst[2] + done};
+        if (nbytes == 1)
+            split_row<1>(src + 3 * done, tail, count - done);
+        else
+            split_row<2>(src + 3 * done, tail, count - done);
     }
-    else if (bits_per_sample <= 16)
+}
+
+void utils::planar_to_triplet(const uint8_t* in, uint8_t* out, const size_t width, const size_t height,
+                              const uint8_t bits_per_sample, const size_t stride)
+{
+    const size_t nbytes = get_nbytes(bits_per_sample, "planar_to_triplet");
+    const size_t row_size = width * nbytes;
+    const size_t plane_size = row_size * height;
+    const auto& masks = get_masks(nbytes);
+    using kernel = size_t (*)(const uint8_t* const*, uint8_t*, size_t, const shuffle_masks&);
+    kernel simd = nullptr;
+#ifdef JLST_X86_DISPATCH
+    simd = cpu::has_avx2() ? merge_avx2 : cpu::has_ssse3() ? merge_ssse3 : nullptr;
+#endif
+    const bool contiguous = stride == 0 || stride == 3 * row_size;
+    const size_t rows = contiguous ? 1 : height;
+    const size_t count = contiguous ? plane_size : row_size;
+    for (size_t line = 0; line != rows; ++line)
     {
-        std::vector<uint16_t> buffer16;
-        buffer16.resize(buffer.size() / 2);
-        std::memcpy(buffer16.data(), buffer.data(), buffer.size());
-        std::vector<uint16_t> tmp{triplet_to_planar_impl(buffer16, width, height, stride / 2)};
-        std::vector<uint8_t> ret;
-        ret.resize(buffer.size());
-        std::memcpy(ret.data(), tmp.data(), buffer.size());
-        return ret;
+        const uint8_t* const src[3] = {in + line * row_size, in + plane_size + line * row_size,
+                                       in + 2 * plane_size + line * row_size};
+        uint8_t* dst = out + line * stride;
+        const size_t done = simd ? simd(src, dst, count, masks) : 0;
+        const uint8_t* const tail[3] = {src[0] + done, src[1] + done, src[2] + done};
+        if (nbytes == 1)
+            merge_row<1>(tail, dst + 3 * done, count - done);
+        else
+            merge_row<2>(tail, dst + 3 * done, count - done);
     }
-    throw std::invalid_argument("triplet_to_planar");
 }
 
-std::vector<uint8_t> utils::planar_to_triplet(const std::vector<uint8_t>& buffer, const size_t width, const size_t height,
-                                              const uint8_t bits_per_sample, const size_t stride)
+void utils::byteswap16(const uint8_t* in, uint8_t* out, size_t size)
 {
-    if (bits_per_sample <= 8)
+    size = size & ~static_cast<size_t>(1);
+    size_t i = 0;
+#ifdef JLST_X86_DISPATCH
+    if (cpu::has_avx2())
+        i = byteswap16_avx2(in, out, size);
+    if (cpu::has_ssse3())
+        i += byteswap16_ssse3(in + i, out + i, size - i);
+#endif
+    for (; i < size; i += 2)
     {
-        return planar_to_triplet_impl(buffer, width, height, stride);
+        const uint8_t lo = in[i];
+        out[i] = in[i + 1];
+        out[i + 1] = lo;
     }
-    else if (bits_per_sample <= 16)
+}
+
+void utils::write_byteswap16(dest& d, const uint8_t* data, size_t size)
+{
+    // small enough to stay in L2, the whole image is never duplicated:
+    const size_t block_size = 64 * 1024;
+    byte_buffer scratch(std::min(size, block_size));
+    for (size_t offset = 0; offset < size; offset += block_size)
     {
-        std::vector<uint16_t> buffer16;
-        buffer16.resize(buffer.size() / 2);
-        std::memcpy(buffer16.data(), buffer.data(), buffer.size());
-        std::vector<uint16_t> tmp{planar_to_triplet_impl(buffer16, width, height, stride / 2)};
-        std::vector<uint8_t> ret;
-        ret.resize(buffer.size());
-        std::memcpy(ret.data(), tmp.data(), buffer.size());
-        return ret;
+        const size_t n = std::min(block_size, size - offset);
+        byteswap16(data + offset, scratch.data(), n);
+        if (n % 2)
+            scratch[n - 1] = data[offset + n - 1];
+        d.write(scratch.data(), n);
     }
-    throw std::invalid_argument("planar_to_triplet");
 }
 
+byte_buffer utils::triplet_to_planar(const byte_buffer& buffer, const size_t width, const size_t height,
+                                     const uint8_t bits_per_sample, const size_t stride)
+{
+    byte_buffer result(3 * width * height * ((bits_per_sample + 7) / 8));
+    triplet_to_planar(buffer.data(), result.data(), width, height, bits_per_sample, stride);
+    return result;
+}
+
+byte_buffer utils::planar_to_triplet(const byte_buffer& buffer, const size_t width, const size_t height,
+                                     const uint8_t bits_per_sample, const size_t stride)
+{
+    const size_t row_size = 3 * width * ((bits_per_sample + 7) / 8);
+    byte_buffer result((stride ? stride : row_size) * height);
+    planar_to_triplet(buffer.data(), result.data(), width, height, bits_per_sample, stride);
+    return result;
+}
 } // namespace jlst
@@ -2,18 +2,36 @@
 // SPDX-License-Identifier: BSD-3-Clause
 #pragma once
 
+#include "allocator.h"
+
 #include <cstddef> // std::size_t
 #include <cstdint>
-#include <vector>
 
 namespace jlst {
+class dest;
 struct utils final
 {
-    static std::vector<uint8_t> triplet_to_planar(const std::vector<uint8_t>& buffer, const size_t width,
-                                                  const size_t height, const uint8_t bits_per_sample, const size_t stride);
+    static byte_buffer triplet_to_planar(const byte_buffer& buffer, const size_t width, const size_t height,
+                                         const uint8_t bits_per_sample, const size_t stride);
+
+    static byte_buffer planar_to_triplet(const byte_buffer& buffer, const size_t width, const size_t height,
+                                         const uint8_t bits_per_sample, const size_t stride);
+
+    /**
+     * Same as above, writing straight into `out`. `stride` is the size in
+     * bytes of a row of triplets (0 when rows are contiguous), the planes are
+     * always contiguous. 8 and 16 bits samples use SSSE3 or AVX2 shuffles when
+     * the CPU supports them.
+     */
+    static void triplet_to_planar(const uint8_t* in, uint8_t* out, const size_t width, const size_t height,
+                                  const uint8_t bits_per_sample, const size_t stride);
+    static void planar_to_triplet(const uint8_t* in, uint8_t* out, const size_t width, const size_t height,
+                                  const uint8_t bits_per_sample, const size_t stride);
 
-    static std::vector<uint8_t> planar_to_triplet(const std::vector<uint8_t>& buffer, const size_t width,
-                                                  const size_t height, const uint8_t bits_per_sample, const size_t stride);
+    // swaps the bytes of the 16 bits samples of `in` into `out`, which may be `in`
+    static void byteswap16(const uint8_t* in, uint8_t* out, size_t size);
+    // writes the byte-swapped samples, one cache-sized block at a time
+    static void write_byteswap16(dest& d, const uint8_t* data, size_t size);
 };
 
 } // namespace jlst
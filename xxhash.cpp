@@ -0,0 +1,159 @@
+// Copyright (c) Mathieu Malaterre
+// SPDX-License-Identifier: BSD-3-Clause
+#include "xxhash.h"
+
+#include <cstdio>  // std::snprintf
+#include <cstring> // std::memcpy
+
+namespace jlst {
+namespace {
+constexpr uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t prime3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t prime5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+// the digest is defined on little endian words:
+inline uint64_t read64(const uint8_t* p)
+{
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; --i)
+        v = (v << 8) | p[i];
+    return v;
+}
+inline uint32_t read32(const uint8_t* p)
+{
+    return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 | static_cast<uint32_t>(p[2]) << 16 |
+           static_cast<uint32_t>(p[3]) << 24;
+}
+
+inline uint64_t round(uint64_t acc, uint64_t input)
+{
+    acc += input * prime2;
+    acc = rotl(acc, 31);
+    return acc * prime1;
+}
+inline uint64_t merge_round(uint64_t acc, uint64_t val)
+{
+    acc ^= round(0, val);
+    return acc * prime1 + prime4;
+}
+
+// consumes whole 32 bytes stripes, returns the pointer past the last one
+const uint8_t* consume(uint64_t acc[4], const uint8_t* p, const uint8_t* end)
+{
+    uint64_t v1 = acc[0], v2 = acc[1], v3 = acc[2], v4 = acc[3];
+    while (end - p >= 32)
+    {
+        v1 = round(v1, read64(p));
+        v2 = round(v2, read64(p + 8));
+        v3 = round(v3, read64(p + 16));
+        v4 = round(v4, read64(p + 24));
+        p += 32;
+    }
+    acc[0] = v1;
+    acc[1] = v2;
+    acc[2] = v3;
+    acc[3] = v4;
+    return p;
+}
+} // namespace
+
+xxh64::xxh64(uint64_t seed) : seed_(seed)
+{
+    acc_[0] = seed + prime1 + prime2;
+    acc_[1] = seed + prime2;
+    acc_[2] = seed;
+    acc_[3] = seed - prime1;
+}
+
+void xxh64::update(const void* data, size_t size)
+{
+    auto p = static_cast<const uint8_t*>(data);
+    const uint8_t* const end = p + size;
+    total_ += size;
+    if (tail_size_ + size < sizeof tail_)
+    {
+        std::memcpy(tail_ + tail_size_, p, size);
+        tail_size_ += size;
+        return;
+    }
+    if (tail_size_)
+    {
+        const size_t n = sizeof tail_ - tail_size_;
+        std::memcpy(tail_ + tail_size_, p, n);
+        consume(acc_, tail_, tail_ + sizeof tail_);
+        p += n;
+        tail_size_ = 0;
+    }
+    p = consume(acc_, p, end);
+    tail_size_ = static_cast<size_t>(end - p);
+    std::memcpy(tail_, p, tail_size_);
+}
+
+uint64_t xxh64::digest() const
+{
+    uint64_t h;
+    if (total_ >= 32)
+    {
+        h = rotl(acc_[0], 1) + rotl(acc_[1], 7) + rotl(acc_[2], 12) + rotl(acc_[3], 18);
+        h = merge_round(h, acc_[0]);
+        h = merge_round(h, acc_[1]);
+        h = merge_round(h, acc_[2]);
+        h = merge_round(h, acc_[3]);
+    }
+    else
+    {
+        h = seed_ + prime5;
+    }
+    h += total_;
+
+    const uint8_t* p = tail_;
+    const uint8_t* const end = tail_ + tail_size_;
+    while (end - p >= 8)
+    {
+        h ^= round(0, read64(p));
+        h = rotl(h, 27) * prime1 + prime4;
+        p += 8;
+    }
+    if (end - p >= 4)
+    {
+        h ^= read32(p) * prime1;
+        h = rotl(h, 23) * prime2 + prime3;
+        p += 4;
+    }
+    while (p < end)
+    {
+        h ^= *p++ * prime5;
+        h = rotl(h, 11) * prime1;
+    }
+
+    // avalanche:
+    h ^= h >> 33;
+    h *= prime2;
+    h ^= h >> 29;
+    h *= prime3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t xxh64::checksum(const void* data, size_t size, uint64_t seed)
+{
+    xxh64 h(seed);
+    h.update(data, size);
+    return h.digest();
+}
+
+std::string xxh64::compute(byte_buffer const& buffer)
+{
+    const uint64_t value = checksum(buffer.data(), buffer.size());
+    char xxh64[24];
+    std::snprintf(xxh64, sizeof xxh64, "%016llx", static_cast<unsigned long long>(value));
+    return xxh64;
+}
+} // namespace jlst
@@ -0,0 +1,34 @@
+// Copyright (c) Mathieu Malaterre
+// SPDX-License-Identifier: BSD-3-Clause
+#pragma once
+
+#include "allocator.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace jlst {
+// XXH64 (https://github.com/Cyan4973/xxHash), non-cryptographic digest meant
+// for bulk integrity sweeps: several times faster than CRC-32 without PCLMUL.
+class xxh64
+{
+public:
+    explicit xxh64(uint64_t seed = 0);
+
+    // streaming interface, the digest of A|B is the same as A then B
+    void update(const void* data, size_t size);
+    uint64_t digest() const;
+
+    static uint64_t checksum(const void* data, size_t size, uint64_t seed = 0);
+    // returns the digest formatted as `%016x`
+    static std::string compute(byte_buffer const& buffer);
+
+private:
+    uint64_t acc_[4];
+    uint64_t seed_;
+    uint64_t total_{};
+    uint8_t tail_[32];
+    size_t tail_size_{};
+};
+} // end namespace jlst